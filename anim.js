@@ -0,0 +1,94 @@
+/**
+ * Script for compiling keyframe animations into the segment tables
+ *   interpreted by the master (src/master/animation.c)
+ *
+ * Usage: node anim.js src/master/animations.json > src/master/ANIMATIONS.txt
+ *
+ * Every animation is a looping list of keyframes. A keyframe holds its colour
+ *   or fades to the colour of the next keyframe over 'duration' steps:
+ *   easing 'hold', 'linear', 'in', 'out' or 'in-out' (quadratic).
+ *   'rateShift' speeds up the whole animation by a power of two.
+ */
+
+const fs = require('fs');
+
+// Values are stored in Q16.16
+const ONE = 65536;
+
+// Returns the per-step increment and the change of that increment, both in Q16.16
+function easingSteps(easing, d, n) {
+    switch (easing) {
+        case 'hold':
+            return [0, 0];
+        case 'linear':
+            return [d / n, 0];
+        case 'in':
+            // v(i) = d * (i / n)^2
+            return [d / (n * n), 2 * d / (n * n)];
+        case 'out':
+            // v(i) = d * (1 - (1 - i / n)^2)
+            return [d * (2 * n - 1) / (n * n), -2 * d / (n * n)];
+        default:
+            throw new Error('Unknown easing: ' + easing);
+    }
+}
+
+function compileSegment(from, to, steps, easing) {
+    const deltas = [0, 1, 2].map(c => easingSteps(easing, (to[c] - from[c]) * ONE, steps));
+
+    return {
+        start: from.map(v => Math.round(v * ONE)),
+        delta: deltas.map(d => Math.round(d[0])),
+        delta2: deltas.map(d => Math.round(d[1])),
+        steps
+    };
+}
+
+function compileAnimation(animation) {
+    const keyframes = animation.keyframes;
+    const segments = [];
+
+    keyframes.forEach((keyframe, i) => {
+        const from = keyframe.color;
+        const to = keyframes[(i + 1) % keyframes.length].color;
+        const easing = keyframe.easing || 'linear';
+        const steps = keyframe.duration;
+
+        if (steps < 1 || steps > 65535) {
+            throw new Error(animation.name + ': invalid duration ' + steps);
+        }
+
+        if (easing === 'in-out') {
+            // Ease in to the midpoint, ease out from there
+            const mid = [0, 1, 2].map(c => (from[c] + to[c]) / 2);
+            const half = Math.max(1, Math.floor(steps / 2));
+
+            segments.push(compileSegment(from, mid, half, 'in'));
+            segments.push(compileSegment(mid, to, Math.max(1, steps - half), 'out'));
+        } else {
+            segments.push(compileSegment(from, to, steps, easing));
+        }
+    });
+
+    if (segments.length > 255) {
+        throw new Error(animation.name + ': too many segments');
+    }
+
+    return segments;
+}
+
+const animations = JSON.parse(fs.readFileSync(process.argv[2], 'utf8'));
+
+for (const animation of animations) {
+    const segments = compileAnimation(animation);
+    const list = a => '{ ' + a.join(', ') + ' }';
+
+    process.stdout.write('// ' + animation.name + '\n');
+    process.stdout.write('{ (const struct animation_segment[]) {\n');
+
+    for (const s of segments) {
+        process.stdout.write('    { ' + [list(s.start), list(s.delta), list(s.delta2), s.steps].join(', ') + ' },\n');
+    }
+
+    process.stdout.write('}, ' + segments.length + ', ' + (animation.rateShift || 0) + ' },\n');
+}
@@ -0,0 +1,161 @@
+// Checks the master's integer HSV conversion against a floating-point
+//   reference and measures its speed on the host.
+//
+// Usage: color_bench [--check]
+//
+//   scale_8() is compared with round(a * b / 255) for every pair of bytes, and
+//   color_from_hsv() with a double precision conversion of the same hue ranges
+//   for every hue and a grid of saturations and values. With --check the exit
+//   status is non-zero if scale_8() is off anywhere or a channel deviates by
+//   more than MAX_CHANNEL_ERROR 8-bit steps.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Compiled in, so that the static helpers can be checked directly
+#include "master/color.c"
+
+// The integer version rounds every intermediate product
+#define MAX_CHANNEL_ERROR 1
+
+#define BENCHMARK_ROUNDS 20
+
+static unsigned check_scale_8() {
+    unsigned mismatches = 0;
+
+    for (int a = 0; a < 256; a++) {
+        for (int b = 0; b < 256; b++) {
+            uint8_t expected = lround(a * b / 255.0);
+
+            if (scale_8(a, b) != expected) {
+                mismatches++;
+            }
+        }
+    }
+
+    return mismatches;
+}
+
+// Hue 0-1535 in regions of 256, the fraction scaled by 1/255 like the integer version
+static void reference_hsv(uint16_t hue, uint8_t saturation, uint8_t value, double rgb[3]) {
+    double s = saturation / 255.0;
+    double v = value;
+    double f = (hue & 0xff) / 255.0;
+
+    double p = v * (1 - s);
+    double q = v * (1 - s * f);
+    double t = v * (1 - s * (1 - f));
+
+    double r, g, b;
+
+    switch (hue >> 8) {
+        case 0: r = v; g = t; b = p; break;
+        case 1: r = q; g = v; b = p; break;
+        case 2: r = p; g = v; b = t; break;
+        case 3: r = p; g = q; b = v; break;
+        case 4: r = t; g = p; b = v; break;
+        default: r = v; g = p; b = q; break;
+    }
+
+    rgb[0] = r;
+    rgb[1] = g;
+    rgb[2] = b;
+}
+
+struct comparison {
+    unsigned colors;
+    unsigned over_limit;
+    double error_sum;
+    double error_max;
+};
+
+static void compare_hsv(struct comparison *comparison) {
+    memset(comparison, 0, sizeof(*comparison));
+
+    for (uint16_t hue = 0; hue <= COLOR_HUE_MAX; hue++) {
+        for (int saturation = 0; saturation < 256; saturation += 5) {
+            for (int value = 0; value < 256; value += 5) {
+                uint32_t color = color_from_hsv(hue, saturation, value);
+                // The top 8 bits of each channel, expand_10() only repeats them below
+                uint8_t channels[3] = { COLOR_R(color) >> 2, COLOR_G(color) >> 2, COLOR_B(color) >> 2 };
+                double reference[3];
+
+                reference_hsv(hue, saturation, value, reference);
+
+                comparison->colors++;
+
+                for (int i = 0; i < 3; i++) {
+                    double error = fabs(channels[i] - reference[i]);
+
+                    comparison->error_sum += error;
+
+                    if (error > comparison->error_max) {
+                        comparison->error_max = error;
+                    }
+
+                    if (error > MAX_CHANNEL_ERROR) {
+                        comparison->over_limit++;
+
+                        printf("hue %u, saturation %d, value %d, channel %d: %u instead of %.2f\n",
+                            hue, saturation, value, i, channels[i], reference[i]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static double benchmark() {
+    uint32_t checksum = 0;
+    unsigned conversions = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+        for (uint16_t hue = 0; hue <= COLOR_HUE_MAX; hue++) {
+            // Every saturation and value once per hue and round, in a varying order
+            uint8_t saturation = hue * 7 + round;
+            uint8_t value = hue * 13 + round * 3;
+
+            for (int i = 0; i < 256; i++) {
+                checksum += color_from_hsv(hue, saturation++, value--);
+                conversions++;
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // Keeps the results alive
+    if (checksum == 1) {
+        printf("\n");
+    }
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / conversions;
+}
+
+int main(int argc, char **argv) {
+    bool check = argc > 1 && strcmp(argv[1], "--check") == 0;
+
+    unsigned mismatches = check_scale_8();
+
+    printf("scale_8: %u of 65536 products differ from round(a * b / 255)\n", mismatches);
+
+    struct comparison comparison;
+    compare_hsv(&comparison);
+
+    printf("HSV: %u colours compared, channel error (8-bit) mean %.3f, max %.2f, %u over %d\n",
+        comparison.colors, comparison.error_sum / (3.0 * comparison.colors), comparison.error_max,
+        comparison.over_limit, MAX_CHANNEL_ERROR);
+
+    double conversion_ns = benchmark();
+
+    printf("Conversion: %.1f ns per colour on this host\n", conversion_ns);
+
+    return check && (mismatches > 0 || comparison.over_limit > 0) ? 1 : 0;
+}
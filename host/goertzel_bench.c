@@ -0,0 +1,236 @@
+// Checks the visualizer's fixed-point Goertzel bank against a floating-point
+//   reference and measures its speed on the host.
+//
+// Usage: goertzel_bench [--check]
+//
+//   Test blocks (sines on and between the bins, several amplitudes, noise,
+//   square waves, silence) are analysed by goertzel_analyze() and by a double
+//   precision Goertzel with exact coefficients. The differences are reported in
+//   level steps (1/8 octave of power). With --check the exit status is non-zero
+//   if a level that is clearly above the noise deviates by more than
+//   MAX_LEVEL_ERROR steps.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "goertzel.h"
+
+// Only levels above this are compared. Below it the states have so few bits left
+//   after the shift before squaring that a few LSBs make octaves. The visualizer
+//   treats anything below 80 (LEVEL_NOISE_FLOOR) as silence anyway
+#define MIN_REFERENCE_LEVEL 64
+#define MAX_LEVEL_ERROR 2
+
+#define BENCHMARK_BLOCKS 200000
+
+static const uint8_t bands[GOERTZEL_BAND_COUNT] = GOERTZEL_BANDS;
+
+static uint32_t random_state = 0x2545f491;
+
+// xorshift32, every run analyses the same blocks
+static uint32_t random_next() {
+    uint32_t x = random_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    random_state = x;
+
+    return x;
+}
+
+static uint16_t clamp_sample(double value) {
+    long sample = lround(value);
+
+    return sample < 0 ? 0 : sample > 1023 ? 1023 : sample;
+}
+
+// Biased around 512 like the line input
+static void make_sine(uint16_t *samples, double bin, double amplitude, double phase) {
+    for (int i = 0; i < GOERTZEL_BLOCK_SIZE; i++) {
+        samples[i] = clamp_sample(512 + amplitude * sin(2 * M_PI * bin * i / GOERTZEL_BLOCK_SIZE + phase));
+    }
+}
+
+// The level quantizer of goertzel.c: 8 * log2(value), with the three bits below
+//   the MSB as the fraction. The reference uses it as well, so that only the
+//   arithmetic of the kernel is compared
+static double level_q3(double power) {
+    if (power < 1) {
+        return 0;
+    }
+
+    int exponent = (int) floor(log2(power));
+    double fraction = power / pow(2, exponent) - 1;
+
+    return 8 * exponent + floor(fraction * 8);
+}
+
+// Same scaling as the fixed-point version: the states are shifted by 5 bits before squaring
+static void reference_levels(const uint16_t *samples, double levels[GOERTZEL_BAND_COUNT]) {
+    for (int band = 0; band < GOERTZEL_BAND_COUNT; band++) {
+        double coeff = 2 * cos(2 * M_PI * bands[band] / GOERTZEL_BLOCK_SIZE);
+        double s1 = 0, s2 = 0;
+
+        for (int i = 0; i < GOERTZEL_BLOCK_SIZE; i++) {
+            double s0 = ((int) samples[i] - 512) + coeff * s1 - s2;
+            s2 = s1;
+            s1 = s0;
+        }
+
+        double power = (s1 * s1 + s2 * s2 - coeff * s1 * s2) / 1024;
+
+        levels[band] = level_q3(power);
+    }
+}
+
+struct comparison {
+    unsigned blocks;
+    unsigned compared;
+    unsigned over_limit;
+    double error_sum;
+    double error_max;
+};
+
+static void compare(const char *name, const uint16_t *samples, struct comparison *comparison) {
+    uint8_t levels[GOERTZEL_BAND_COUNT];
+    double reference[GOERTZEL_BAND_COUNT];
+
+    goertzel_analyze(samples, levels);
+    reference_levels(samples, reference);
+
+    comparison->blocks++;
+
+    for (int band = 0; band < GOERTZEL_BAND_COUNT; band++) {
+        if (reference[band] < MIN_REFERENCE_LEVEL) {
+            continue;
+        }
+
+        double error = fabs(levels[band] - reference[band]);
+
+        comparison->compared++;
+        comparison->error_sum += error;
+
+        if (error > comparison->error_max) {
+            comparison->error_max = error;
+        }
+
+        if (error > MAX_LEVEL_ERROR) {
+            comparison->over_limit++;
+
+            printf("%s, bin %d: %d instead of %.0f\n", name, bands[band], levels[band], reference[band]);
+        }
+    }
+}
+
+static void compare_all(struct comparison *comparison) {
+    static const double amplitudes[] = { 511, 256, 64, 16, 4 };
+    uint16_t samples[GOERTZEL_BLOCK_SIZE];
+    char name[64];
+
+    memset(comparison, 0, sizeof(*comparison));
+
+    // On the bins, between them and in between the bands
+    for (double bin = 0.5; bin <= 31.5; bin += 0.5) {
+        for (size_t a = 0; a < sizeof(amplitudes) / sizeof(*amplitudes); a++) {
+            for (int phase = 0; phase < 4; phase++) {
+                make_sine(samples, bin, amplitudes[a], phase * M_PI / 4);
+
+                snprintf(name, sizeof(name), "sine bin %.1f amplitude %.0f", bin, amplitudes[a]);
+                compare(name, samples, comparison);
+            }
+        }
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        // Noise of varying loudness
+        uint16_t amplitude = 1 + random_next() % 512;
+
+        for (int j = 0; j < GOERTZEL_BLOCK_SIZE; j++) {
+            samples[j] = clamp_sample(512 + (double) (random_next() % (2 * amplitude + 1)) - amplitude);
+        }
+
+        compare("noise", samples, comparison);
+
+        // Two tones
+        make_sine(samples, bands[random_next() % GOERTZEL_BAND_COUNT], 200, 0);
+        uint16_t other[GOERTZEL_BLOCK_SIZE];
+        make_sine(other, bands[random_next() % GOERTZEL_BAND_COUNT], 200, random_next() % 7);
+
+        for (int j = 0; j < GOERTZEL_BLOCK_SIZE; j++) {
+            samples[j] = samples[j] + other[j] - 512;
+        }
+
+        compare("two tones", samples, comparison);
+    }
+
+    // Clipped full scale square waves
+    for (int period = 2; period <= GOERTZEL_BLOCK_SIZE; period *= 2) {
+        for (int i = 0; i < GOERTZEL_BLOCK_SIZE; i++) {
+            samples[i] = (i % period) < period / 2 ? 1023 : 0;
+        }
+
+        compare("square", samples, comparison);
+    }
+
+    for (int i = 0; i < GOERTZEL_BLOCK_SIZE; i++) {
+        samples[i] = 512;
+    }
+
+    compare("silence", samples, comparison);
+}
+
+static double benchmark() {
+    uint16_t samples[GOERTZEL_BLOCK_SIZE];
+    uint8_t levels[GOERTZEL_BAND_COUNT];
+    unsigned checksum = 0;
+
+    for (int i = 0; i < GOERTZEL_BLOCK_SIZE; i++) {
+        samples[i] = random_next() & 0x3ff;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < BENCHMARK_BLOCKS; i++) {
+        // Vary the input so that nothing can be hoisted out of the loop
+        samples[i % GOERTZEL_BLOCK_SIZE] ^= 1;
+
+        goertzel_analyze(samples, levels);
+        checksum += levels[i % GOERTZEL_BAND_COUNT];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // Keeps the results alive
+    if (checksum == 1) {
+        printf("\n");
+    }
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / BENCHMARK_BLOCKS;
+}
+
+int main(int argc, char **argv) {
+    bool check = argc > 1 && strcmp(argv[1], "--check") == 0;
+
+    struct comparison comparison;
+    compare_all(&comparison);
+
+    printf("Reference comparison: %u blocks, %u levels above %d compared\n",
+        comparison.blocks, comparison.compared, MIN_REFERENCE_LEVEL);
+    printf("Level error (1/8 octave): mean %.2f, max %.2f, %u over %d\n",
+        comparison.error_sum / comparison.compared, comparison.error_max, comparison.over_limit, MAX_LEVEL_ERROR);
+
+    double block_ns = benchmark();
+
+    printf("Analysis: %.0f ns per block on this host (%.1f M samples/s)\n",
+        block_ns, GOERTZEL_BLOCK_SIZE * 1e3 / block_ns);
+
+    return check && comparison.over_limit > 0 ? 1 : 0;
+}
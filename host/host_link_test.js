@@ -0,0 +1,316 @@
+/**
+ * Loopback test of the host link: rgbctl.js' Link against the master's host.c,
+ *   which host_loopback runs on a simulated UART at 115200 baud.
+ *
+ * Usage: node host_link_test.js <host_loopback binary> [--check]
+ *
+ *   Every scenario starts a new host_loopback. Requests are COMMAND frames with
+ *   a unique id, so the loopback can tell how often each was executed. The
+ *   scenarios cover the clean link (throughput and latency), corrupted bytes in
+ *   both directions (CRC NAKs and retransmits), a receive buffer overflow,
+ *   invalid requests, a retransmitted frame and a frame that stops halfway.
+ *   With --check the exit status is non-zero if a scenario doesn't behave as
+ *   described in its expectations.
+ */
+
+const { spawn } = require('child_process');
+const { EventEmitter } = require('events');
+const path = require('path');
+
+const { Link, Decoder, Message, encodeFrame } = require(path.join(__dirname, '..', 'rgbctl.js'));
+
+// Any command, the loopback only counts the id behind it
+const TEST_COMMAND = 0x01;
+// Keeps the loopback's host task from running for 10 ms
+const STALL_COMMAND = 0xff;
+
+// Link.stream() keeps this many requests in flight as well
+const IN_FLIGHT = 4;
+
+// xorshift32, every run corrupts the same bytes
+let randomState = 0x2545f491;
+
+function random() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >>> 17;
+    randomState ^= randomState << 5;
+    randomState >>>= 0;
+
+    return randomState / 0x100000000;
+}
+
+// Flips one bit in a share of the bytes
+function corrupt(chunk, rate) {
+    const bytes = Buffer.from(chunk);
+
+    for (let i = 0; i < bytes.length; i++) {
+        if (random() < rate) {
+            bytes[i] ^= 1 << Math.floor(random() * 8);
+        }
+    }
+
+    return bytes;
+}
+
+function sleep(ms) {
+    return new Promise(resolve => setTimeout(resolve, ms));
+}
+
+// A host_loopback process with a Link on its stdin/stdout
+class Loopback {
+    constructor(binary, options = {}) {
+        this.process = spawn(binary, [], { stdio: ['pipe', 'pipe', 'pipe'] });
+        this.input = new EventEmitter();
+        this.report = '';
+
+        this.process.stdout.on('data', chunk => {
+            this.input.emit('data', options.corruptFromMaster ? corrupt(chunk, options.corruptFromMaster) : chunk);
+        });
+        this.process.stderr.on('data', chunk => {
+            this.report += chunk;
+        });
+
+        const output = {
+            write: chunk => this.process.stdin.write(options.corruptToMaster ? corrupt(chunk, options.corruptToMaster) : chunk)
+        };
+
+        this.link = new Link(this.input, output, { timeout: 50, retries: 5 });
+    }
+
+    // Bytes that bypass the Link
+    writeRaw(bytes) {
+        this.process.stdin.write(Buffer.from(bytes));
+    }
+
+    // Resolves with the executions reported by host_loopback
+    close() {
+        return new Promise(resolve => {
+            this.process.on('close', () => {
+                const match = /executed (\d+) duplicates (\d+)/.exec(this.report);
+
+                resolve({ executed: Number(match[1]), duplicates: Number(match[2]) });
+            });
+
+            this.process.stdin.end();
+        });
+    }
+}
+
+let nextId = 0;
+
+function command(link, byte = TEST_COMMAND) {
+    const id = nextId++ & 0xffff;
+
+    return link.command(byte, [id >> 8, id & 0xff]);
+}
+
+// Sends 'count' requests with IN_FLIGHT of them outstanding, like Link.stream()
+async function run(link, count, onSent = () => {}) {
+    const latencies = [];
+    const inFlight = new Set();
+    let failed = 0;
+
+    const start = process.hrtime.bigint();
+
+    for (let i = 0; i < count; i++) {
+        const request = command(link).then(answer => {
+            latencies.push(answer.latency);
+        }, () => {
+            failed++;
+        }).then(() => {
+            inFlight.delete(request);
+        });
+        inFlight.add(request);
+
+        onSent(i);
+
+        if (inFlight.size >= IN_FLIGHT) {
+            await Promise.race(inFlight);
+        }
+    }
+
+    await Promise.all(inFlight);
+
+    const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+    latencies.sort((a, b) => a - b);
+
+    return {
+        failed,
+        rate: count / seconds,
+        mean: latencies.reduce((sum, latency) => sum + latency, 0) / Math.max(latencies.length, 1),
+        p99: latencies[Math.floor(latencies.length * 0.99)] || 0
+    };
+}
+
+function describe(result) {
+    return `${result.rate.toFixed(0)} requests/s, latency mean ${result.mean.toFixed(2)} ms, ` +
+        `p99 ${result.p99.toFixed(2)} ms, ${result.failed} failed`;
+}
+
+const scenarios = [
+    {
+        name: 'clean',
+        async run(binary) {
+            const loopback = new Loopback(binary);
+            const result = await run(loopback.link, 1000);
+            const stats = await loopback.link.stats();
+            const executions = await loopback.close();
+
+            return {
+                text: `${describe(result)}, ${executions.executed} executed, ${executions.duplicates} duplicated`,
+                ok: result.failed === 0 && executions.executed === 1000 && executions.duplicates === 0
+                    && stats.crcErrors === 0 && stats.rxOverflows === 0
+            };
+        }
+    },
+    {
+        name: 'to master 0.5% corrupt',
+        async run(binary) {
+            const loopback = new Loopback(binary, { corruptToMaster: 0.005 });
+            const result = await run(loopback.link, 500);
+            const executions = await loopback.close();
+
+            // A corrupted frame is never executed, a corrupted sequence number makes a retransmit look new
+            return {
+                text: `${describe(result)}, ${executions.executed} executed, ${executions.duplicates} duplicated`,
+                ok: result.failed === 0 && executions.executed - executions.duplicates === 500
+            };
+        }
+    },
+    {
+        name: 'from master 0.5% corrupt',
+        async run(binary) {
+            const loopback = new Loopback(binary, { corruptFromMaster: 0.005 });
+            const result = await run(loopback.link, 500);
+            const executions = await loopback.close();
+
+            // Lost answers are retransmitted, the master only recognizes a retransmit of its last request
+            return {
+                text: `${describe(result)}, ${executions.executed} executed, ${executions.duplicates} duplicated`,
+                ok: result.failed === 0 && executions.executed - executions.duplicates === 500
+            };
+        }
+    },
+    {
+        name: 'receive overflow',
+        async run(binary) {
+            const loopback = new Loopback(binary);
+
+            // Garbage while the host task is stalled, more than the receive buffer holds
+            const result = await run(loopback.link, 300, i => {
+                if (i === 100) {
+                    command(loopback.link, STALL_COMMAND);
+                    loopback.writeRaw(new Array(100).fill(0));
+                }
+            });
+            const afterOverflow = await loopback.link.stats();
+
+            // Nothing may overflow once the link has recovered. Together with the stalling request 601 are executed
+            const more = await run(loopback.link, 300);
+            const stats = await loopback.link.stats();
+            const executions = await loopback.close();
+
+            return {
+                text: `${describe(result)}, ${afterOverflow.rxOverflows} bytes dropped, ` +
+                    `${stats.rxOverflows - afterOverflow.rxOverflows} more after recovery, ${executions.duplicates} duplicated`,
+                ok: result.failed === 0 && more.failed === 0 && afterOverflow.rxOverflows > 0
+                    && stats.rxOverflows === afterOverflow.rxOverflows
+                    && executions.executed - executions.duplicates === 601
+            };
+        }
+    },
+    {
+        name: 'invalid requests',
+        async run(binary) {
+            const loopback = new Loopback(binary);
+            let rejected = 0;
+
+            for (const [type, payload] of [[0x7f, []], [Message.STREAM_FRAME, [0x04, 0x00, 0, 0, 0, 0]], [Message.COMMAND, []]]) {
+                await loopback.link.request(type, payload).catch(error => {
+                    if (error.message === 'Invalid request') {
+                        rejected++;
+                    }
+                });
+            }
+
+            const result = await run(loopback.link, 10);
+            await loopback.close();
+
+            return {
+                text: `${rejected} of 3 rejected, ${result.failed} later requests failed`,
+                ok: rejected === 3 && result.failed === 0
+            };
+        }
+    },
+    {
+        name: 'retransmit',
+        async run(binary) {
+            const loopback = new Loopback(binary);
+            const answers = [];
+            const decoder = new Decoder(frame => answers.push(frame));
+            loopback.process.stdout.on('data', chunk => decoder.push(chunk));
+
+            const frame = encodeFrame(42, Message.COMMAND, [TEST_COMMAND, 0xff, 0xff]);
+            loopback.writeRaw(frame);
+            await sleep(20);
+            loopback.writeRaw(frame);
+            await sleep(20);
+
+            const executions = await loopback.close();
+            const acks = answers.filter(answer => answer.type === Message.ACK && answer.sequence === 42).length;
+
+            return {
+                text: `${acks} of 2 acknowledged, executed ${executions.executed} time(s)`,
+                ok: acks === 2 && executions.executed === 1
+            };
+        }
+    },
+    {
+        name: 'partial frame',
+        async run(binary) {
+            const loopback = new Loopback(binary);
+
+            // Sync, length and sequence, then nothing for longer than the frame timeout
+            loopback.writeRaw([0xa5, 3, 1]);
+            await sleep(20);
+
+            const result = await run(loopback.link, 10);
+            const stats = await loopback.link.stats();
+            await loopback.close();
+
+            return {
+                text: `${stats.timeouts} timeout(s), ${result.failed} later requests failed`,
+                ok: stats.timeouts === 1 && result.failed === 0
+            };
+        }
+    }
+];
+
+async function main(args) {
+    const binary = args.find(arg => !arg.startsWith('--'));
+    const check = args.includes('--check');
+
+    if (binary === undefined) {
+        console.error('Usage: node host_link_test.js <host_loopback binary> [--check]');
+        process.exit(1);
+    }
+
+    let failures = 0;
+
+    for (const scenario of scenarios) {
+        const result = await scenario.run(binary);
+
+        console.log(`${result.ok ? 'ok  ' : 'FAIL'} ${scenario.name}: ${result.text}`);
+
+        if (!result.ok) {
+            failures++;
+        }
+    }
+
+    process.exit(check && failures > 0 ? 1 : 0);
+}
+
+main(process.argv.slice(2)).catch(error => {
+    console.error(error.stack);
+    process.exit(1);
+});
@@ -0,0 +1,212 @@
+// Runs the master's host link (src/master/host.c) in real time on a simulated
+//   USCI_A0: the bytes on stdin are received, the replies are written to stdout,
+//   both at the pace of 115200 baud. host_poll() runs every 8 ticks like the
+//   master's host task. host_link_test.js drives it with rgbctl.js, it can also
+//   stand in for a master with any other host program.
+//
+// Usage: host_loopback
+//
+//   The message handler accepts COMMAND (the bytes after the command are a
+//   16-bit request id, every execution of an id is counted; the command
+//   STALL_COMMAND keeps the host task from running for STALL_US), STREAM_FRAME
+//   (checked like the master does) and GET_STATS (the master's layout without
+//   the tasks), everything else is invalid. Once stdin is closed and the
+//   replies are sent, the executions are reported on stderr:
+//     executed <requests> duplicates <requests executed more than once>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <msp430.h>
+
+#include "host.h"
+#include "sched.h"
+
+// 10 bits per byte at 115200 baud
+#define BYTE_US 87
+// The host task's period: 8 ticks of 64 us
+#define POLL_US 512
+// Replies that are still on their way when stdin closes
+#define DRAIN_US 20000
+
+// Like a long task in the master's main loop, the receive interrupt keeps filling the ring
+#define STALL_COMMAND 0xff
+#define STALL_US 10000
+
+volatile uint8_t P1SEL;
+volatile uint8_t P1SEL2;
+volatile uint8_t IE2;
+volatile uint8_t IFG2;
+volatile uint8_t UCA0CTL0;
+volatile uint8_t UCA0CTL1;
+volatile uint8_t UCA0BR0;
+volatile uint8_t UCA0BR1;
+volatile uint8_t UCA0MCTL;
+volatile uint8_t UCA0RXBUF;
+volatile uint8_t UCA0TXBUF;
+
+void USCIAB0RX_ISR();
+void USCIAB0TX_ISR();
+
+static uint64_t now_us;
+static uint64_t stall_end_us;
+
+static uint8_t executions[65536];
+static unsigned executed;
+static unsigned duplicates;
+
+uint16_t sched_ticks() {
+    return now_us / 64;
+}
+
+static uint64_t clock_us() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t) time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+static uint8_t put_u16(uint8_t *buffer, uint8_t index, uint16_t value) {
+    buffer[index++] = value >> 8;
+    buffer[index++] = value;
+
+    return index;
+}
+
+static bool handle_message(uint8_t type, const uint8_t *payload, uint8_t length) {
+    switch (type) {
+        case HOST_MESSAGE_COMMAND: {
+            if (length < 3) {
+                return false;
+            }
+
+            uint16_t id = (uint16_t) payload[1] << 8 | payload[2];
+
+            executed++;
+
+            if (payload[0] == STALL_COMMAND) {
+                stall_end_us = now_us + STALL_US;
+            }
+
+            if (executions[id]++ == 1) {
+                duplicates++;
+            }
+            return true;
+        }
+        case HOST_MESSAGE_STREAM_FRAME:
+            if (length < 6) {
+                return false;
+            }
+
+            for (uint8_t i = 0; i < 6; i += 2) {
+                if (((uint16_t) payload[i] << 8 | payload[i + 1]) > 1023) {
+                    return false;
+                }
+            }
+            return true;
+        case HOST_MESSAGE_GET_STATS: {
+            uint8_t stats[9];
+            uint8_t stats_length = 0;
+
+            struct host_stats host_stats;
+            host_get_stats(&host_stats);
+
+            stats[stats_length++] = 0;
+            stats_length = put_u16(stats, stats_length, host_stats.frames);
+            stats_length = put_u16(stats, stats_length, host_stats.crc_errors);
+            stats_length = put_u16(stats, stats_length, host_stats.rx_overflows);
+            stats_length = put_u16(stats, stats_length, host_stats.timeouts);
+
+            host_reply(HOST_MESSAGE_STATS, stats, stats_length);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+int main() {
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+    host_init(handle_message);
+
+    uint64_t start = clock_us();
+    uint64_t next_rx = 0;
+    uint64_t next_tx = 0;
+    uint64_t next_poll = 0;
+    uint64_t closed_at = 0;
+
+    uint8_t input[256];
+    size_t input_fill = 0;
+    size_t input_index = 0;
+    bool input_closed = false;
+
+    uint8_t output[256];
+    size_t output_fill = 0;
+
+    while (!input_closed || now_us - closed_at < DRAIN_US) {
+        now_us = clock_us() - start;
+
+        if (input_index == input_fill && !input_closed) {
+            ssize_t count = read(STDIN_FILENO, input, sizeof(input));
+
+            if (count > 0) {
+                input_fill = count;
+                input_index = 0;
+            } else if (count == 0 || errno != EAGAIN) {
+                input_closed = true;
+                closed_at = now_us;
+            }
+        }
+
+        // One byte per byte time, a pause doesn't save any up
+        if (input_index < input_fill && now_us >= next_rx) {
+            UCA0RXBUF = input[input_index++];
+            IFG2 |= UCA0RXIFG;
+            USCIAB0RX_ISR();
+            IFG2 &= ~UCA0RXIFG;
+
+            next_rx = (now_us > next_rx + BYTE_US ? now_us : next_rx) + BYTE_US;
+        }
+
+        if ((IE2 & UCA0TXIE) && now_us >= next_tx) {
+            IFG2 |= UCA0TXIFG;
+            USCIAB0TX_ISR();
+            IFG2 &= ~UCA0TXIFG;
+
+            // The interrupt disables itself instead of sending when the ring is empty
+            if (IE2 & UCA0TXIE) {
+                output[output_fill++] = UCA0TXBUF;
+
+                next_tx = (now_us > next_tx + BYTE_US ? now_us : next_tx) + BYTE_US;
+            }
+        }
+
+        if (now_us >= next_poll && now_us >= stall_end_us) {
+            host_poll();
+
+            next_poll = (now_us > next_poll + POLL_US ? now_us : next_poll) + POLL_US;
+        }
+
+        if (output_fill > 0) {
+            fwrite(output, 1, output_fill, stdout);
+            fflush(stdout);
+
+            output_fill = 0;
+        }
+
+        struct timespec pause = { 0, 10000 };
+        nanosleep(&pause, NULL);
+    }
+
+    fprintf(stderr, "executed %u duplicates %u\n", executed, duplicates);
+
+    return 0;
+}
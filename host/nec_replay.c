@@ -0,0 +1,631 @@
+// Replays IR edge traces through the NEC decoder the same way the capture
+//   (TIMER0_A0) and overflow (TIMER0_A1) interrupts of the IR slave do, with a
+//   simulated 1 MHz Timer_A0 that is cleared whenever the decoder asks for it.
+//   The IR slave's main loop is simulated along with them: it sleeps in LPM0
+//   until an interrupt wakes it up, polls the decoder, handles the event and
+//   goes back to sleep unless another interrupt came in meanwhile. The time
+//   each step takes on the MSP430 is estimated below.
+//
+// Usage: nec_replay [--check] [trace file]
+//
+//   Without a file, synthetic button presses (frames followed by repeat codes)
+//   are replayed with jitter, noise and dropped edges. For every scenario the
+//   decode rate, the spurious events and the latency from the interrupt that
+//   completes a frame or repeat code to its slave_enqueue() are reported, then
+//   the throughput of a long session. With --check the exit status is non-zero
+//   if a scenario decodes less than it is expected to.
+//
+//   A trace file has one edge per line: time in us and the sensor level after
+//   the edge (0 during an IR burst, 1 while idle). Lines starting with '#' are
+//   ignored. The decoded events and the throughput are reported.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "nec.h"
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof(*(array)))
+
+// Timer_A0 overflows every 65536 us
+#define TIMER_PERIOD 65536
+
+// NEC timings in us
+#define BURST_START 9000
+#define PAUSE_START 4500
+#define PAUSE_REPEAT 2250
+#define BURST_BIT 562
+#define PAUSE_BIT_0 562
+#define PAUSE_BIT_1 1687
+// Repeat codes follow the frame and each other every 108 ms
+#define REPEAT_PERIOD 108000
+
+// A decoded event belongs to a transmission that was completed this close to it
+#define MATCH_WINDOW 20000
+
+// Estimated cost of the IR slave's code at 8 MHz in CPU cycles, there is no
+//   hardware multiplier
+#define CPU_MHZ 8
+#define CYCLES(count) (((count) + CPU_MHZ - 1) / CPU_MHZ)
+// The capture or overflow interrupt with nec_edge() or nec_timeout(), entry and reti included
+#define ISR_US CYCLES(120)
+// From the sleep check around to nec_poll(): clearing wake_pending and the duty cycle bookkeeping
+#define LOOP_US CYCLES(80)
+// nec_poll() with nothing pending
+#define POLL_US CYCLES(30)
+// decode_nec_buffer(): 64 lengths checked and the bits shifted in
+#define DECODE_US CYCLES(1400)
+// handle_command(): the keymap lookup up to slave_enqueue()
+#define HANDLE_US CYCLES(250)
+// report_duty() once per window, the 32-bit multiplication and division are done in software
+#define DUTY_REPORT_US CYCLES(1200)
+#define DUTY_WINDOW_LENGTH (1ULL << 20)
+
+#define SCENARIO_PRESSES 500
+#define SESSION_LENGTH (10 * 60 * 1000000ULL)
+
+struct edge {
+    uint64_t time;
+    // Sensor level after the edge, the receiver output is low during a burst
+    bool level;
+};
+
+struct event {
+    // Expected events: the edge that completes them. Decoded events: their slave_enqueue()
+    uint64_t time;
+    // Decoded events: the first interrupt after the previous nec_poll(), usually the one that completed them
+    uint64_t completed;
+    enum nec_event type;
+    uint16_t address;
+    uint8_t command;
+};
+
+struct edges {
+    struct edge *items;
+    size_t count;
+    size_t capacity;
+};
+
+struct events {
+    struct event *items;
+    size_t count;
+    size_t capacity;
+};
+
+struct scenario {
+    const char *name;
+    // Every edge is moved by up to this many us, in either direction
+    uint16_t jitter;
+    // Short pulses that aren't part of any transmission
+    uint16_t glitches_per_second;
+    // Edges that the capture misses, in 1/10000
+    uint16_t drop_rate;
+    // --check fails below this decode rate (percent)
+    uint8_t required_percent;
+};
+
+static const struct scenario scenarios[] = {
+    { "clean", 0, 0, 0, 100 },
+    { "jitter 50 us", 50, 0, 0, 100 },
+    { "jitter 100 us", 100, 0, 0, 100 },
+    { "jitter 200 us", 200, 0, 0, 0 },
+    { "jitter 300 us", 300, 0, 0, 0 },
+    { "noise 1/s", 0, 1, 0, 0 },
+    { "noise 10/s", 0, 10, 0, 0 },
+    { "drop 0.1%", 0, 0, 10, 0 },
+    { "drop 1%", 0, 0, 100, 0 },
+    { "jitter 100 us, noise 1/s, drop 0.1%", 100, 1, 10, 0 }
+};
+
+static uint32_t random_state = 1;
+
+// xorshift32, every run replays the same traces
+static uint32_t random_next() {
+    uint32_t x = random_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    random_state = x;
+
+    return x;
+}
+
+static uint32_t random_range(uint32_t min, uint32_t max) {
+    return min + random_next() % (max - min + 1);
+}
+
+static void *grow(void *items, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) {
+        return items;
+    }
+
+    *capacity = *capacity ? *capacity * 2 : 1024;
+    items = realloc(items, *capacity * size);
+
+    if (items == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    return items;
+}
+
+static void add_edge(struct edges *edges, uint64_t time, bool level) {
+    edges->items = grow(edges->items, &edges->capacity, edges->count, sizeof(struct edge));
+    edges->items[edges->count++] = (struct edge) { time, level };
+}
+
+static void add_event(struct events *events, uint64_t time, enum nec_event type, uint16_t address, uint8_t command) {
+    events->items = grow(events->items, &events->capacity, events->count, sizeof(struct event));
+    events->items[events->count++] = (struct event) { time, time, type, address, command };
+}
+
+static uint64_t now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t) time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+// Synthetic transmissions, 'time' is where the next one starts
+
+static uint64_t add_burst(struct edges *edges, uint64_t time, uint16_t length) {
+    add_edge(edges, time, false);
+    add_edge(edges, time + length, true);
+
+    return time + length;
+}
+
+static uint64_t add_frame(struct edges *edges, struct events *expected, uint64_t time, uint16_t address, uint8_t command) {
+    uint64_t start = time;
+    uint8_t bytes[4] = { address >> 8, address, command, ~command };
+
+    time = add_burst(edges, time, BURST_START) + PAUSE_START;
+
+    for (uint8_t i = 0; i < 32; i++) {
+        bool bit = bytes[i / 8] & (1 << (i % 8));
+
+        time = add_burst(edges, time, BURST_BIT) + (bit ? PAUSE_BIT_1 : PAUSE_BIT_0);
+    }
+
+    // The stop burst ends the pause of the last bit
+    add_event(expected, time, NEC_EVENT_FRAME, address, command);
+    add_burst(edges, time, BURST_BIT);
+
+    return start + REPEAT_PERIOD;
+}
+
+static uint64_t add_repeat(struct edges *edges, struct events *expected, uint64_t time, uint16_t address, uint8_t command) {
+    uint64_t start = time;
+
+    time = add_burst(edges, time, BURST_START) + PAUSE_REPEAT;
+
+    add_event(expected, time, NEC_EVENT_REPEAT, address, command);
+    add_burst(edges, time, BURST_BIT);
+
+    return start + REPEAT_PERIOD;
+}
+
+// Button presses with pauses in between, some held for a few repeat codes.
+//   Returns the time after the last one
+static uint64_t add_presses(struct edges *edges, struct events *expected, uint64_t time, uint64_t end, size_t count) {
+    for (size_t i = 0; i < count && time < end; i++) {
+        time += random_range(150000, 900000);
+
+        // Mostly the default remote
+        uint16_t address = random_range(0, 3) ? 0x10ef : random_next();
+        uint8_t command = random_next();
+        uint8_t repeats = random_range(0, 1) ? 0 : random_range(1, 6);
+
+        time = add_frame(edges, expected, time, address, command);
+
+        for (uint8_t j = 0; j < repeats; j++) {
+            time = add_repeat(edges, expected, time, address, command);
+        }
+    }
+
+    // Long enough for the repeat timeout to expire
+    return time + 500000;
+}
+
+// Copies 'clean' with the scenario's impairments
+static void impair(const struct edges *clean, struct edges *impaired, const struct scenario *scenario, uint64_t end) {
+    uint64_t next_glitch = UINT64_MAX;
+    uint64_t glitch_interval = scenario->glitches_per_second ? 1000000 / scenario->glitches_per_second : 0;
+
+    if (glitch_interval) {
+        next_glitch = random_range(0, glitch_interval * 2);
+    }
+
+    bool level = true;
+    uint64_t previous = 0;
+
+    for (size_t i = 0; i <= clean->count; i++) {
+        uint64_t time = i < clean->count ? clean->items[i].time : end;
+
+        // Glitches that end before the next edge invert the level briefly
+        while (next_glitch < time) {
+            uint64_t glitch_end = next_glitch + random_range(10, 150);
+
+            if (glitch_end < time && next_glitch > previous) {
+                add_edge(impaired, next_glitch, !level);
+                add_edge(impaired, glitch_end, level);
+                previous = glitch_end;
+            }
+
+            next_glitch += random_range(1, glitch_interval * 2);
+        }
+
+        if (i == clean->count) {
+            break;
+        }
+
+        level = clean->items[i].level;
+
+        if (random_range(0, 9999) < scenario->drop_rate) {
+            continue;
+        }
+
+        if (scenario->jitter) {
+            time = time + random_range(0, scenario->jitter * 2) - scenario->jitter;
+        }
+
+        // Jitter can't reorder edges
+        if (time <= previous) {
+            time = previous + 1;
+        }
+
+        add_edge(impaired, time, level);
+        previous = time;
+    }
+}
+
+enum loop_state {
+    LOOP_ASLEEP,
+    // Running up to nec_poll() at 'time'
+    LOOP_POLL,
+    // Polled and handling the event, up to the sleep check at 'time'
+    LOOP_HANDLE
+};
+
+// The IR slave's main loop
+struct loop {
+    enum loop_state state;
+    uint64_t time;
+    bool wake_pending;
+    bool interrupted;
+    uint64_t first_interrupt;
+    uint64_t next_duty_report;
+    // The decoded event being handled, an interrupt still delays its slave_enqueue()
+    size_t handled;
+};
+
+// Clears wake_pending and does the duty cycle bookkeeping on the way to nec_poll()
+static void loop_continue(struct loop *loop) {
+    loop->wake_pending = false;
+    loop->state = LOOP_POLL;
+    loop->time += LOOP_US;
+
+    if (loop->time >= loop->next_duty_report) {
+        loop->time += DUTY_REPORT_US;
+        loop->next_duty_report += DUTY_WINDOW_LENGTH;
+    }
+}
+
+// Everything the main loop does before 'until'
+static void loop_run(struct loop *loop, struct events *decoded, uint64_t until) {
+    while (loop->state != LOOP_ASLEEP && loop->time < until) {
+        if (loop->state == LOOP_HANDLE) {
+            if (!loop->wake_pending) {
+                loop->state = LOOP_ASLEEP;
+                break;
+            }
+
+            loop_continue(loop);
+            continue;
+        }
+
+        uint16_t address;
+        uint8_t command;
+        enum nec_event type = nec_poll(&address, &command);
+
+        loop->time += POLL_US;
+        loop->handled = SIZE_MAX;
+        loop->state = LOOP_HANDLE;
+
+        if (type != NEC_EVENT_NONE) {
+            loop->time += (type == NEC_EVENT_FRAME ? DECODE_US : 0) + HANDLE_US;
+            loop->handled = decoded->count;
+
+            add_event(decoded, loop->time, type, address, command);
+            decoded->items[loop->handled].completed = loop->first_interrupt;
+        }
+
+        loop->interrupted = false;
+    }
+}
+
+// An interrupt at 'time' wakes the main loop up or preempts it
+static void loop_interrupt(struct loop *loop, struct events *decoded, uint64_t time) {
+    if (!loop->interrupted) {
+        loop->interrupted = true;
+        loop->first_interrupt = time;
+    }
+
+    if (loop->state == LOOP_ASLEEP) {
+        loop->time = time + ISR_US;
+        loop_continue(loop);
+        return;
+    }
+
+    loop->time += ISR_US;
+    loop->wake_pending = true;
+
+    if (loop->handled != SIZE_MAX && decoded->items[loop->handled].time > time) {
+        decoded->items[loop->handled].time += ISR_US;
+    }
+}
+
+// Runs the trace through the decoder like the interrupts and the main loop
+//   would. The decoder keeps its state, so every trace has to end with enough
+//   idle time for it to reset
+static void replay(const struct edges *edges, uint64_t end, struct events *decoded) {
+    // Time of the last TACLR
+    uint64_t timer_start = edges->count ? edges->items[0].time : 0;
+    uint64_t next_overflow = timer_start + TIMER_PERIOD;
+    uint16_t last_capture = 0;
+
+    struct loop loop = { LOOP_ASLEEP, 0, false, false, 0, DUTY_WINDOW_LENGTH, SIZE_MAX };
+
+    for (size_t i = 0; i <= edges->count; i++) {
+        uint64_t time = i < edges->count ? edges->items[i].time : end;
+
+        while (next_overflow <= time) {
+            loop_run(&loop, decoded, next_overflow);
+
+            // TIMER0_A1_ISR
+            last_capture = 0;
+            nec_timeout();
+            loop_interrupt(&loop, decoded, next_overflow);
+
+            next_overflow += TIMER_PERIOD;
+        }
+
+        loop_run(&loop, decoded, time);
+
+        if (i == edges->count) {
+            break;
+        }
+
+        // TIMER0_A0_ISR, CCI is the level after the edge: high after a burst
+        uint16_t timestamp = (uint16_t) (time - timer_start);
+        uint16_t length = timestamp - last_capture;
+        last_capture = timestamp;
+
+        if (nec_edge(length, edges->items[i].level)) {
+            timer_start = time;
+            next_overflow = time + TIMER_PERIOD;
+            last_capture = 0;
+        }
+
+        loop_interrupt(&loop, decoded, time);
+    }
+}
+
+struct score {
+    size_t matched;
+    size_t missed;
+    size_t spurious;
+    int64_t latency_sum;
+    int64_t latency_max;
+};
+
+static void score(const struct events *expected, const struct events *decoded, struct score *score) {
+    bool *used = calloc(expected->count + 1, sizeof(bool));
+    size_t first = 0;
+
+    memset(score, 0, sizeof(*score));
+
+    for (size_t i = 0; i < decoded->count; i++) {
+        const struct event *event = &decoded->items[i];
+        bool found = false;
+
+        while (first < expected->count && expected->items[first].time + MATCH_WINDOW < event->time) {
+            first++;
+        }
+
+        for (size_t j = first; j < expected->count && expected->items[j].time <= event->time + MATCH_WINDOW; j++) {
+            const struct event *match = &expected->items[j];
+
+            if (used[j] || match->type != event->type || match->address != event->address || match->command != event->command) {
+                continue;
+            }
+
+            int64_t latency = (int64_t) event->time - (int64_t) event->completed;
+
+            used[j] = true;
+            found = true;
+
+            score->matched++;
+            score->latency_sum += latency;
+            if (score->matched == 1 || latency > score->latency_max) {
+                score->latency_max = latency;
+            }
+            break;
+        }
+
+        if (!found) {
+            score->spurious++;
+        }
+    }
+
+    score->missed = expected->count - score->matched;
+
+    free(used);
+}
+
+static bool run_scenarios(bool check) {
+    bool passed = true;
+    uint64_t host_ns = 0;
+    size_t host_edges = 0;
+
+    printf("%-38s %9s %7s %8s %9s %23s\n", "scenario", "expected", "rate", "missed", "spurious", "latency mean / max (us)");
+
+    for (size_t i = 0; i < ARRAY_SIZE(scenarios); i++) {
+        const struct scenario *scenario = &scenarios[i];
+        struct edges clean = { 0 }, impaired = { 0 };
+        struct events expected = { 0 }, decoded = { 0 };
+
+        random_state = 0x2545f491 + i;
+
+        uint64_t end = add_presses(&clean, &expected, 100000, UINT64_MAX, SCENARIO_PRESSES);
+        impair(&clean, &impaired, scenario, end);
+
+        uint64_t start = now_ns();
+        replay(&impaired, end, &decoded);
+        host_ns += now_ns() - start;
+        host_edges += impaired.count;
+
+        struct score result;
+        score(&expected, &decoded, &result);
+
+        double percent = 100.0 * result.matched / expected.count;
+        bool ok = percent >= scenario->required_percent;
+
+        printf("%-38s %9zu %6.2f%% %8zu %9zu %15.0f / %5lld%s\n",
+            scenario->name, expected.count, percent, result.missed, result.spurious,
+            result.matched ? (double) result.latency_sum / result.matched : 0.0,
+            (long long) result.latency_max, ok ? "" : "  FAILED");
+
+        if (check && !ok) {
+            passed = false;
+        }
+
+        free(clean.items);
+        free(impaired.items);
+        free(expected.items);
+        free(decoded.items);
+    }
+
+    printf("\nReplay: %.1f ns per edge on this host\n", (double) host_ns / host_edges);
+
+    return passed;
+}
+
+static void report_throughput(const struct edges *edges, const struct events *decoded, uint64_t duration, uint64_t host_ns) {
+    size_t frames = 0;
+
+    for (size_t i = 0; i < decoded->count; i++) {
+        if (decoded->items[i].type == NEC_EVENT_FRAME) {
+            frames++;
+        }
+    }
+
+    double seconds = duration / 1e6;
+
+    printf("%.1f s of trace, %zu edges, %zu frames and %zu repeat codes (%.2f events/s)\n",
+        seconds, edges->count, frames, decoded->count - frames, decoded->count / seconds);
+    printf("Replayed in %.1f ms: %.2f M edges/s, %.0fx real time\n",
+        host_ns / 1e6, edges->count * 1e3 / host_ns, seconds * 1e9 / host_ns);
+}
+
+static void run_session() {
+    static const struct scenario session = { "session", 100, 1, 10, 0 };
+    struct edges clean = { 0 }, impaired = { 0 };
+    struct events expected = { 0 }, decoded = { 0 };
+
+    random_state = 0x9e3779b9;
+
+    uint64_t end = add_presses(&clean, &expected, 100000, SESSION_LENGTH, SIZE_MAX);
+    impair(&clean, &impaired, &session, end);
+
+    uint64_t start = now_ns();
+    replay(&impaired, end, &decoded);
+    uint64_t host_ns = now_ns() - start;
+
+    struct score result;
+    score(&expected, &decoded, &result);
+
+    printf("\nLong session (jitter 100 us, noise 1/s, drop 0.1%%): %.2f%% decoded\n", 100.0 * result.matched / expected.count);
+    report_throughput(&impaired, &decoded, end, host_ns);
+
+    free(clean.items);
+    free(impaired.items);
+    free(expected.items);
+    free(decoded.items);
+}
+
+static bool run_file(const char *path) {
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    struct edges edges = { 0 };
+    struct events decoded = { 0 };
+    char line[128];
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        unsigned long long time;
+        int level;
+
+        if (line[0] == '#' || sscanf(line, "%llu %d", &time, &level) != 2) {
+            continue;
+        }
+
+        add_edge(&edges, time, level != 0);
+    }
+
+    fclose(file);
+
+    // Idle time after the last edge lets pending repeats time out
+    uint64_t end = (edges.count ? edges.items[edges.count - 1].time : 0) + 500000;
+
+    uint64_t start = now_ns();
+    replay(&edges, end, &decoded);
+    uint64_t host_ns = now_ns() - start;
+
+    for (size_t i = 0; i < decoded.count; i++) {
+        const struct event *event = &decoded.items[i];
+
+        printf("%12llu %s %04x %02x\n", (unsigned long long) event->time,
+            event->type == NEC_EVENT_FRAME ? "frame " : "repeat", event->address, event->command);
+    }
+
+    uint64_t duration = edges.count ? end - edges.items[0].time : 0;
+    report_throughput(&edges, &decoded, duration ? duration : 1, host_ns ? host_ns : 1);
+
+    free(edges.items);
+    free(decoded.items);
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    bool check = false;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (path != NULL) {
+        return run_file(path) ? 0 : 1;
+    }
+
+    bool passed = run_scenarios(check);
+    run_session();
+
+    return passed ? 0 : 1;
+}
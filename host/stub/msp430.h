@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+// Just enough of the MSP430 header for the firmware's USCI_A0 code on the host.
+//   The registers are plain variables that the harness defines and drives,
+//   interrupt handlers become ordinary functions the harness calls
+
+#define interrupt(vector) used
+
+extern volatile uint8_t P1SEL;
+extern volatile uint8_t P1SEL2;
+extern volatile uint8_t IE2;
+extern volatile uint8_t IFG2;
+extern volatile uint8_t UCA0CTL0;
+extern volatile uint8_t UCA0CTL1;
+extern volatile uint8_t UCA0BR0;
+extern volatile uint8_t UCA0BR1;
+extern volatile uint8_t UCA0MCTL;
+extern volatile uint8_t UCA0RXBUF;
+extern volatile uint8_t UCA0TXBUF;
+
+#define BIT1 0x02
+#define BIT2 0x04
+
+#define UCA0RXIE 0x01
+#define UCA0TXIE 0x02
+#define UCA0RXIFG 0x01
+#define UCA0TXIFG 0x02
+
+#define UCSWRST 0x01
+#define UCSSEL_2 0x80
+#define UCMODE_0 0x00
+#define UCBRS_7 0x0e
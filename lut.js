@@ -16,7 +16,47 @@ const confs = {
     'sin': {
         xMin: 0,
         xMax: 255,
-        f: x => (Math.sin(x * 2 * Math.PI / 1023) + 1) * 1023 / 2
+        f: x => (Math.sin(x * 2 * Math.PI / 256) + 1) * 1023 / 2
+    },
+    'tri': {
+        xMin: 0,
+        xMax: 255,
+        f: x => (x < 128 ? x : 256 - x) * 1023 / 128
+    },
+    'palette': {
+        xMin: 0,
+        xMax: 255,
+        f: x => {
+            // 32 hues per row. Rows 0-3: full saturation, value 100/75/50/25%;
+            //   rows 4-6: full value, saturation 75/50/25%; row 7: greys
+            const hue = (x & 31) / 32;
+            const row = x >> 5;
+            const s = row < 4 ? 1 : (row < 7 ? (7 - row) / 4 : 0);
+            const v = row < 4 ? (4 - row) / 4 : (row < 7 ? 1 : (x & 31) / 31);
+            const channel = n => {
+                const k = (n + hue * 6) % 6;
+                return Math.round(1023 * v * (1 - s * Math.max(0, Math.min(k, 4 - k, 1))));
+            };
+            // Packed 10:10:10
+            return channel(5) * (1 << 20) + channel(3) * (1 << 10) + channel(1);
+        }
+    },
+    'ws2812': {
+        xMin: 0,
+        xMax: 255,
+        // SPI encoding of a WS2812 byte, 3 SPI bits per data bit: 0 -> 100, 1 -> 110
+        f: x => {
+            let code = 0;
+            for (let bit = 7; bit >= 0; bit--) {
+                code = code * 8 + ((x >> bit) & 1 ? 6 : 4);
+            }
+            return [code >> 16, (code >> 8) & 0xff, code & 0xff];
+        }
+    },
+    'saw': {
+        xMin: 0,
+        xMax: 255,
+        f: x => x * 1023 / 255
     }
 };
 
@@ -24,7 +64,8 @@ const confName = (process.argv.length >= 3) ? process.argv[2].toLowerCase() : 'p
 const conf = confs[confName];
 
 for (let x = conf.xMin; x <= conf.xMax; x++) {
-    process.stdout.write(Math.round(conf.f(x)).toString());
+    // Functions may return several values per x
+    process.stdout.write([].concat(conf.f(x)).map(v => Math.round(v).toString()).join(','));
 
     if (x < conf.xMax) {
         process.stdout.write(',');
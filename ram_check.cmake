@@ -0,0 +1,30 @@
+# Static RAM check of a linked firmware, run after every build (see check_ram() in CMakeLists.txt):
+#   cmake -DSIZE=<size tool> -DFILE=<elf> -DRAM_SIZE=<bytes> -DSTACK_RESERVE=<bytes> -P ram_check.cmake
+#   .data, .bss and .noinit plus the stack reserve must fit into the part's RAM
+
+execute_process(
+    COMMAND "${SIZE}" -A "${FILE}"
+    OUTPUT_VARIABLE sections
+    RESULT_VARIABLE result
+)
+
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${SIZE} failed on ${FILE}")
+endif()
+
+set(static 0)
+string(REGEX MATCHALL "\n\\.(data|bss|noinit)[ \t]+[0-9]+" lines "${sections}")
+
+foreach(line ${lines})
+    string(REGEX REPLACE ".*[ \t]([0-9]+)$" "\\1" bytes "${line}")
+    math(EXPR static "${static} + ${bytes}")
+endforeach()
+
+math(EXPR free "${RAM_SIZE} - ${static}")
+get_filename_component(name "${FILE}" NAME)
+
+message(STATUS "${name}: ${static} of ${RAM_SIZE} bytes RAM static, ${free} left for the stack")
+
+if(free LESS STACK_RESERVE)
+    message(FATAL_ERROR "${name} leaves less than ${STACK_RESERVE} bytes RAM for the stack")
+endif()
@@ -0,0 +1,416 @@
+/**
+ * Host side of the master's UART control protocol (src/master/host.h),
+ *   the master has to be built with -DHOST_LINK=ON
+ *
+ * Usage: node rgbctl.js <device> <command> [arguments]
+ *
+ *   state <on> <brightness> <speed> <r> <g> <b>   set everything at once (colour 0-1023)
+ *   command <byte> [payload bytes...]            send a slave command
+ *   stream <seconds>                             stream a colour wheel as fast as possible,
+ *                                                reports the frame rate and the latency
+ *   stats                                        print the master's statistics
+ *   health                                       print the master's health counters
+ *
+ * The device is switched to 115200 baud raw mode with stty. The Link class only
+ *   needs a readable and a writable stream and can be used on its own.
+ */
+
+const fs = require('fs');
+const { execFileSync } = require('child_process');
+
+const SYNC = 0xa5;
+const PAYLOAD_MAX = 32;
+// Receive buffer of the master, the credit before the first acknowledgement
+const RX_BUFFER_SIZE = 64;
+
+const Message = {
+    COMMAND: 0x01,
+    SET_STATE: 0x02,
+    STREAM_FRAME: 0x03,
+    GET_STATS: 0x04,
+    GET_HEALTH: 0x05,
+    ACK: 0x80,
+    NAK: 0x81,
+    STATS: 0x84,
+    HEALTH: 0x85
+};
+
+// Order of the values in a HEALTH answer (STATS_REGISTER_* in src/shared/commands.h)
+const HEALTH_FIELDS = [
+    'polls', 'pollsWithData', 'nacks', 'skippedSteps',
+    'loopRate', 'loopMinCycles', 'loopMaxCycles', 'awakePercent'
+];
+
+const Nak = {
+    CRC: 0x01,
+    INVALID: 0x02,
+    OVERFLOW: 0x03
+};
+
+// CRC-8, polynomial 0x07
+function crc8(bytes) {
+    let crc = 0;
+
+    for (const byte of bytes) {
+        crc ^= byte;
+
+        for (let i = 0; i < 8; i++) {
+            crc = crc & 0x80 ? ((crc << 1) ^ 0x07) & 0xff : (crc << 1) & 0xff;
+        }
+    }
+
+    return crc;
+}
+
+function encodeFrame(sequence, type, payload) {
+    if (payload.length > PAYLOAD_MAX) {
+        throw new Error('Payload too long');
+    }
+
+    const body = [payload.length, sequence, type, ...payload];
+
+    return Buffer.from([SYNC, ...body, crc8(body)]);
+}
+
+// Splits the received bytes into frames, the same way the master does
+class Decoder {
+    constructor(onFrame) {
+        this.onFrame = onFrame;
+        this.body = null;
+    }
+
+    push(chunk) {
+        for (const byte of chunk) {
+            if (this.body === null) {
+                if (byte === SYNC) {
+                    this.body = [];
+                }
+            } else if (this.body.length === 0 && byte > PAYLOAD_MAX) {
+                this.body = null;
+            } else {
+                this.body.push(byte);
+
+                if (this.body.length === this.body[0] + 4) {
+                    const body = this.body;
+                    this.body = null;
+
+                    if (crc8(body.slice(0, -1)) === body[body.length - 1]) {
+                        this.onFrame({
+                            sequence: body[1],
+                            type: body[2],
+                            payload: Buffer.from(body.slice(3, -1))
+                        });
+                    }
+                }
+            }
+        }
+    }
+}
+
+class Link {
+    constructor(input, output, options = {}) {
+        this.output = output;
+        this.timeout = options.timeout || 50;
+        this.retries = options.retries || 5;
+
+        this.sequence = 0;
+        this.credit = RX_BUFFER_SIZE;
+        // Sent, but not answered yet, by sequence number
+        this.pending = new Map();
+        // Waiting for credit, new requests and the ones to send again after an overflow
+        this.queue = [];
+
+        const decoder = new Decoder(frame => this.handleFrame(frame));
+        input.on('data', chunk => decoder.push(chunk));
+    }
+
+    // Resolves with the answer: { type, payload, latency (ms) }
+    request(type, payload = []) {
+        return new Promise((resolve, reject) => {
+            // 0 is used by the master for frames that don't answer a request
+            this.sequence = this.sequence % 255 + 1;
+
+            this.queue.push({
+                frame: encodeFrame(this.sequence, type, payload),
+                sequence: this.sequence,
+                attempts: 0,
+                resolve,
+                reject
+            });
+
+            this.pump();
+        });
+    }
+
+    pump() {
+        while (this.queue.length > 0 && this.queue[0].frame.length <= this.credit) {
+            const request = this.queue.shift();
+
+            this.pending.set(request.sequence, request);
+            this.transmit(request);
+        }
+    }
+
+    transmit(request) {
+        request.queued = false;
+        request.attempts++;
+        request.sent = process.hrtime.bigint();
+        this.credit -= request.frame.length;
+
+        clearTimeout(request.timer);
+        request.timer = setTimeout(() => this.retry(request, 'Timeout'), this.timeout);
+
+        this.output.write(request.frame);
+    }
+
+    retry(request, reason) {
+        // Queued requests are sent again by pump()
+        if (!this.pending.has(request.sequence) || request.queued) {
+            return;
+        }
+
+        if (request.attempts > this.retries) {
+            this.credit += request.frame.length;
+            this.finish(request);
+            request.reject(new Error(reason));
+            return;
+        }
+
+        // The master acknowledges a retransmit without executing the request again
+        this.credit += request.frame.length;
+        this.transmit(request);
+    }
+
+    finish(request) {
+        clearTimeout(request.timer);
+        this.pending.delete(request.sequence);
+
+        if (request.queued) {
+            this.queue.splice(this.queue.indexOf(request), 1);
+        }
+    }
+
+    handleFrame(frame) {
+        if (frame.type === Message.NAK && frame.payload[0] === Nak.OVERFLOW) {
+            this.requeue();
+            return;
+        }
+
+        const request = this.pending.get(frame.sequence);
+
+        if (request === undefined) {
+            return;
+        }
+
+        if (frame.type === Message.NAK) {
+            if (frame.payload[0] === Nak.CRC) {
+                this.retry(request, 'CRC error');
+            } else {
+                this.finish(request);
+                request.reject(new Error('Invalid request'));
+            }
+            return;
+        }
+
+        // A queued request's bytes were already given back by requeue()
+        const queued = request.queued;
+        this.finish(request);
+
+        if (frame.type === Message.ACK) {
+            // The free space the master reported, minus what was sent since
+            let credit = frame.payload[0];
+            for (const other of this.pending.values()) {
+                if (!other.queued) {
+                    credit -= other.frame.length;
+                }
+            }
+            this.credit = Math.max(credit, 0);
+        } else if (!queued) {
+            // Other answers don't report the space, assume the request was consumed
+            this.credit += request.frame.length;
+        }
+
+        request.resolve({
+            type: frame.type,
+            payload: frame.payload,
+            latency: Number(process.hrtime.bigint() - request.sent) / 1e6
+        });
+
+        this.pump();
+    }
+
+    // Anything in flight may have been hit by an overflow. The master has emptied its
+    //   receive buffer when it reports one, but the credit isn't known: only the first
+    //   frame is sent right away, its answer reports the space for the others.
+    //   Requests stay pending, so answers that still arrive finish them
+    requeue() {
+        const requests = [];
+
+        for (const request of [...this.pending.values()]) {
+            if (request.queued) {
+                continue;
+            }
+
+            if (request.attempts > this.retries) {
+                this.finish(request);
+                request.reject(new Error('Receive buffer overflow'));
+            } else {
+                clearTimeout(request.timer);
+                request.queued = true;
+                requests.push(request);
+            }
+        }
+
+        if (requests.length === 0) {
+            return;
+        }
+
+        this.queue.unshift(...requests);
+        this.credit = requests[0].frame.length;
+
+        this.pump();
+    }
+
+    command(command, payload = []) {
+        return this.request(Message.COMMAND, [command, ...payload]);
+    }
+
+    setState(on, brightness, speed, r, g, b) {
+        const color = ((r & 0x3ff) << 20 | (g & 0x3ff) << 10 | (b & 0x3ff)) >>> 0;
+
+        return this.request(Message.SET_STATE, [
+            on ? 1 : 0, brightness, speed,
+            color >>> 24, (color >>> 16) & 0xff, (color >>> 8) & 0xff, color & 0xff
+        ]);
+    }
+
+    streamFrame(r, g, b) {
+        return this.request(Message.STREAM_FRAME, [r >> 8, r & 0xff, g >> 8, g & 0xff, b >> 8, b & 0xff]);
+    }
+
+    async stats() {
+        const { payload } = await this.request(Message.GET_STATS);
+
+        const stats = {
+            awakePercent: payload[0],
+            frames: payload.readUInt16BE(1),
+            crcErrors: payload.readUInt16BE(3),
+            rxOverflows: payload.readUInt16BE(5),
+            timeouts: payload.readUInt16BE(7),
+            tasks: []
+        };
+
+        for (let i = 9; i + 1 < payload.length; i += 2) {
+            stats.tasks.push({ share: payload[i] / 256, overruns: payload[i + 1] });
+        }
+
+        return stats;
+    }
+
+    async health() {
+        const { payload } = await this.request(Message.GET_HEALTH);
+        const health = {};
+
+        HEALTH_FIELDS.forEach((field, i) => {
+            health[field] = payload.readUInt16BE(i * 2);
+        });
+
+        return health;
+    }
+}
+
+// Colour wheel over 1536 steps, like the master's HSV conversion
+function wheel(step) {
+    const sector = Math.floor(step / 256) % 6;
+    const rising = (step % 256) * 4;
+    const falling = 1023 - rising;
+
+    return [
+        [1023, rising, 0],
+        [falling, 1023, 0],
+        [0, 1023, rising],
+        [0, falling, 1023],
+        [rising, 0, 1023],
+        [1023, 0, falling]
+    ][sector];
+}
+
+async function stream(link, seconds) {
+    const end = Date.now() + seconds * 1000;
+    const latencies = [];
+    let step = 0;
+
+    // Keep a few frames in flight, the credit limits them further
+    const inFlight = new Set();
+
+    while (Date.now() < end) {
+        const [r, g, b] = wheel(step % 1536);
+        step += 8;
+
+        const request = link.streamFrame(r, g, b).then(answer => {
+            latencies.push(answer.latency);
+            inFlight.delete(request);
+        });
+        inFlight.add(request);
+
+        if (inFlight.size >= 4) {
+            await Promise.race(inFlight);
+        }
+    }
+
+    await Promise.all(inFlight);
+
+    latencies.sort((a, b) => a - b);
+    const mean = latencies.reduce((sum, latency) => sum + latency, 0) / latencies.length;
+
+    console.log(`${(latencies.length / seconds).toFixed(1)} frames/s, latency mean ${mean.toFixed(2)} ms, ` +
+        `p99 ${latencies[Math.floor(latencies.length * 0.99)].toFixed(2)} ms, max ${latencies[latencies.length - 1].toFixed(2)} ms`);
+}
+
+async function main(args) {
+    if (args.length < 2) {
+        console.error('Usage: node rgbctl.js <device> state|command|stream|stats|health [arguments]');
+        process.exit(1);
+    }
+
+    const [device, command, ...rest] = args;
+    const numbers = rest.map(Number);
+
+    execFileSync('stty', ['-F', device, '115200', 'raw', '-echo']);
+
+    const input = fs.createReadStream(device);
+    const output = fs.createWriteStream(device, { flags: 'r+' });
+    const link = new Link(input, output);
+
+    switch (command) {
+        case 'state':
+            await link.setState(...numbers);
+            break;
+        case 'command':
+            await link.command(numbers[0], numbers.slice(1));
+            break;
+        case 'stream':
+            await stream(link, numbers[0] || 5);
+            break;
+        case 'stats':
+            console.log(JSON.stringify(await link.stats(), null, 4));
+            break;
+        case 'health':
+            console.log(JSON.stringify(await link.health(), null, 4));
+            break;
+        default:
+            console.error(`Unknown command '${command}'`);
+            process.exit(1);
+    }
+
+    process.exit(0);
+}
+
+if (require.main === module) {
+    main(process.argv.slice(2)).catch(error => {
+        console.error(error.message);
+        process.exit(1);
+    });
+}
+
+module.exports = { Link, Decoder, Message, Nak, encodeFrame, crc8 };
@@ -0,0 +1,73 @@
+#include "animation.h"
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof(*(array)))
+
+const struct animation animations[] = {
+#include "ANIMATIONS.txt"
+};
+
+const uint8_t animation_count = ARRAY_SIZE(animations);
+
+static void load_segment(struct animation_state *state, uint8_t index) {
+    const struct animation_segment *segment = &state->animation->segments[index];
+
+    state->segment = index;
+    state->step = 0;
+
+    for (uint8_t c = 0; c < ANIMATION_CHANNEL_COUNT; c++) {
+        state->value[c] = segment->start[c];
+        state->delta[c] = segment->delta[c];
+    }
+}
+
+static void step(struct animation_state *state) {
+    const struct animation_segment *segment = &state->animation->segments[state->segment];
+
+    state->step++;
+
+    if (state->step >= segment->steps) {
+        // Start the next segment from its exact start values, so rounding errors don't accumulate
+        uint8_t next = state->segment + 1;
+        if (next == state->animation->segment_count) {
+            next = 0;
+        }
+
+        load_segment(state, next);
+        return;
+    }
+
+    for (uint8_t c = 0; c < ANIMATION_CHANNEL_COUNT; c++) {
+        state->value[c] += state->delta[c];
+        state->delta[c] += segment->delta2[c];
+    }
+}
+
+void animation_start(struct animation_state *state, const struct animation *animation) {
+    state->animation = animation;
+    state->rate_accumulator = 0;
+
+    load_segment(state, 0);
+}
+
+void animation_advance(struct animation_state *state, uint8_t speed) {
+    state->rate_accumulator += (uint16_t) (speed + 1) << state->animation->rate_shift;
+
+    while (state->rate_accumulator >= ANIMATION_STEP_UNITS) {
+        state->rate_accumulator -= ANIMATION_STEP_UNITS;
+
+        step(state);
+    }
+}
+
+uint16_t animation_value(const struct animation_state *state, uint8_t channel) {
+    int16_t value = state->value[channel] >> 16;
+
+    // Rounded deltas may overshoot slightly
+    if (value < 0) {
+        return 0;
+    } else if (value > 1023) {
+        return 1023;
+    }
+
+    return value;
+}
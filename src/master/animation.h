@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+// Keyframe animations, compiled by anim.js into segments with precomputed
+//   per-step deltas, so advancing them only takes additions.
+//   All values are Q16.16 with the integer part ranging from 0 to 1023.
+
+#define ANIMATION_CHANNEL_COUNT 3
+
+// Speed units that make up one step
+#define ANIMATION_STEP_UNITS 16
+
+struct animation_segment {
+    int32_t start[ANIMATION_CHANNEL_COUNT];
+    // Added to the value every step
+    int32_t delta[ANIMATION_CHANNEL_COUNT];
+    // Added to the delta every step (quadratic easing)
+    int32_t delta2[ANIMATION_CHANNEL_COUNT];
+    uint16_t steps;
+};
+
+struct animation {
+    const struct animation_segment *segments;
+    uint8_t segment_count;
+    // Steps run 2^rate_shift times as fast as with 0
+    uint8_t rate_shift;
+};
+
+struct animation_state {
+    const struct animation *animation;
+    uint8_t segment;
+    uint16_t step;
+    uint16_t rate_accumulator;
+    int32_t value[ANIMATION_CHANNEL_COUNT];
+    int32_t delta[ANIMATION_CHANNEL_COUNT];
+};
+
+extern const struct animation animations[];
+extern const uint8_t animation_count;
+
+void animation_start(struct animation_state *state, const struct animation *animation);
+// Advance by speed + 1 units
+void animation_advance(struct animation_state *state, uint8_t speed);
+// Current value of a channel (0-1023)
+uint16_t animation_value(const struct animation_state *state, uint8_t channel);
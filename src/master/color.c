@@ -0,0 +1,61 @@
+#include "color.h"
+
+// 32 hues in 8 shades, see lut.js
+static const uint32_t COLOR_PALETTE[COLOR_PALETTE_SIZE] = {
+#include "PALETTE.txt"
+};
+
+uint32_t color_palette(uint16_t index) {
+    return COLOR_PALETTE[index];
+}
+
+// a * b / 255, rounded
+static uint8_t scale_8(uint8_t a, uint8_t b) {
+    uint16_t product = 0;
+    uint16_t term = a;
+
+    while (b != 0) {
+        if (b & 1) {
+            product += term;
+        }
+
+        term <<= 1;
+        b >>= 1;
+    }
+
+    // Rounds to nearest: with y = x + 128, round(x / 255) == (y + (y >> 8)) >> 8
+    //   for every product of two bytes
+    product += 128;
+
+    return (product + (product >> 8)) >> 8;
+}
+
+uint16_t color_expand_10(uint8_t x) {
+    return x << 2 | x >> 6;
+}
+
+uint32_t color_from_hsv(uint16_t hue, uint8_t saturation, uint8_t value) {
+    if (hue > COLOR_HUE_MAX) {
+        hue = COLOR_HUE_MAX;
+    }
+
+    uint8_t region = hue >> 8;
+    uint8_t fraction = hue & 0xff;
+
+    uint8_t p = scale_8(value, 255 - saturation);
+    uint8_t q = scale_8(value, 255 - scale_8(saturation, fraction));
+    uint8_t t = scale_8(value, 255 - scale_8(saturation, 255 - fraction));
+
+    uint8_t r, g, b;
+
+    switch (region) {
+        case 0: r = value; g = t; b = p; break;
+        case 1: r = q; g = value; b = p; break;
+        case 2: r = p; g = value; b = t; break;
+        case 3: r = p; g = q; b = value; break;
+        case 4: r = t; g = p; b = value; break;
+        default: r = value; g = p; b = q; break;
+    }
+
+    return COLOR(color_expand_10(r), color_expand_10(g), color_expand_10(b));
+}
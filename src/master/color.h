@@ -1,10 +1,23 @@
-
 #pragma once
 
 #include <stdint.h>
 
-struct color {
-    uint16_t r;
-    uint16_t g;
-    uint16_t b;
-};
+// Colours are three 10-bit channels packed into 32 bits:
+//   00rrrrrrrrrrggggggggggbbbbbbbbbb
+#define COLOR(r, g, b) (((uint32_t) (r) << 20) | ((uint32_t) (g) << 10) | (uint32_t) (b))
+#define COLOR_R(color) ((uint16_t) ((color) >> 20) & 0x3ff)
+#define COLOR_G(color) ((uint16_t) ((color) >> 10) & 0x3ff)
+#define COLOR_B(color) ((uint16_t) (color) & 0x3ff)
+// All bits of the three channels
+#define COLOR_MASK 0x3fffffffUL
+
+#define COLOR_PALETTE_SIZE 256
+
+// Hue ranges from 0 to 1535 (6 * 256)
+#define COLOR_HUE_MAX 1535
+
+uint32_t color_palette(uint16_t index);
+// 8-bit to 10-bit channel, the top bits are repeated below
+uint16_t color_expand_10(uint8_t x);
+// Integer-only conversion, the only multiplications are 8x8 bit shift-and-add
+uint32_t color_from_hsv(uint16_t hue, uint8_t saturation, uint8_t value);
@@ -1,56 +1,23 @@
 
-static const struct color colors_static[] = {
+static const uint32_t colors_static[] = {
     // Shades of red     
-    { 1023, 0, 0 },      
-    { 1023, 256, 0 },  
-    { 1023, 512, 0 },  
-    { 1023, 768, 0 },  
-    { 1023, 1023, 0 }, 
+    COLOR(1023, 0, 0),      
+    COLOR(1023, 256, 0),  
+    COLOR(1023, 512, 0),  
+    COLOR(1023, 768, 0),  
+    COLOR(1023, 1023, 0), 
     // Shades of green    
-    { 0, 1023, 0 },    
-    { 0, 1023, 256 },  
-    { 0, 1023, 512 },  
-    { 0, 1023, 768 },  
-    { 0, 1023, 1023 }, 
+    COLOR(0, 1023, 0),    
+    COLOR(0, 1023, 256),  
+    COLOR(0, 1023, 512),  
+    COLOR(0, 1023, 768),  
+    COLOR(0, 1023, 1023), 
     // Shades of blue   
-    { 0, 0, 1023 },  
-    { 256, 0, 1023 },
-    { 512, 0, 1023 },
-    { 768, 0, 1023 },
-    { 1023, 0, 1023 },
+    COLOR(0, 0, 1023),  
+    COLOR(256, 0, 1023),
+    COLOR(512, 0, 1023),
+    COLOR(768, 0, 1023),
+    COLOR(1023, 0, 1023),
     // White
-    { 1023, 1023, 1023 },
-};
-
-static const struct color colors_flash[] = {
-    { 1023, 0, 0 },
-    { 0, 1023, 0 },
-    { 0, 0, 1023 }
-};
-
-static const struct color colors_strobe[] = {
-    { 1023, 0, 0 },
-    { 0, 1023, 0 },
-    { 0, 0, 1023 },
-    { 1023, 1023, 0 },
-    { 0, 1023, 1023 },
-    { 1023, 0, 1023 },
-    { 1023, 1023, 1023 }
-};
-
-static const struct color colors_fade[] = {
-    { 1023, 0, 0 },
-    { 0, 0, 0 },
-    { 0, 1023, 0 },
-    { 0, 0, 0 },
-    { 0, 0, 1023 },
-    { 0, 0, 0 }
-};
-
-static const struct color colors_smooth[] = {
-    { 0, 1023, 0 },
-    { 1023, 0, 0 },
-    { 0, 0, 1023 },
-    { 0, 1023, 0 },
-    { 1023, 1023, 1023 }
+    COLOR(1023, 1023, 1023),
 };
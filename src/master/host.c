@@ -0,0 +1,250 @@
+#include "host.h"
+
+#include <msp430.h>
+#include <stddef.h>
+
+#include <shared/ring.h>
+
+#include "uart.h"
+#include "sched.h"
+
+#ifdef RGB_BACKEND_WS2812
+#error "The host link and the WS2812 back end both need USCI_A0"
+#endif
+
+// A frame that stops for this many ticks (~5 ms) is dropped
+#define HOST_FRAME_TIMEOUT 80
+
+// Received bytes are only queued by the interrupt, ~5 ms at full speed
+RING_DEFINE(host_rx_ring, 64);
+// Sent by the transmit interrupt
+RING_DEFINE(host_tx_ring, 128);
+
+enum host_parse_state {
+    HOST_PARSE_SYNC,
+    HOST_PARSE_LENGTH,
+    HOST_PARSE_BODY
+};
+
+static bool (*host_message_handler)(uint8_t type, const uint8_t *payload, uint8_t length) = NULL;
+
+static enum host_parse_state host_parse_state = HOST_PARSE_SYNC;
+// Length, sequence, type, payload, crc
+static uint8_t host_frame[HOST_PAYLOAD_MAX + 4];
+static uint8_t host_frame_fill = 0;
+static uint16_t host_frame_start = 0;
+
+static uint8_t host_sequence = 0;
+static bool host_replied = false;
+
+static uint8_t host_last_sequence = 0;
+static bool host_last_sequence_valid = false;
+static uint16_t host_rx_overflows_seen = 0;
+
+static struct host_stats host_stats;
+
+static uint8_t crc8_update(uint8_t crc, uint8_t data) {
+    crc ^= data;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        if (crc & 0x80) {
+            crc = (crc << 1) ^ 0x07;
+        } else {
+            crc <<= 1;
+        }
+    }
+
+    return crc;
+}
+
+void host_init(bool (*message_handler)(uint8_t type, const uint8_t *payload, uint8_t length)) {
+    host_message_handler = message_handler;
+
+    // Initialize UART pins
+    P1SEL |= UART_RXD | UART_TXD;
+    P1SEL2 |= UART_RXD | UART_TXD;
+
+    // Enter reset state
+    UCA0CTL1 = UCSWRST;
+
+    // 8 bits data, no parity, 1 stop bit
+    UCA0CTL0 = UCMODE_0;
+    // SMCLK
+    UCA0CTL1 |= UCSSEL_2;
+    // Baud rate: 115200 bps @ 16 MHz (16 MHz / 115200 = 138.9)
+    UCA0BR0 = 138;
+    UCA0BR1 = 0;
+    UCA0MCTL = UCBRS_7;
+
+    // Release USCI reset
+    UCA0CTL1 &= ~UCSWRST;
+
+    IE2 |= UCA0RXIE;
+}
+
+static void host_send(uint8_t sequence, uint8_t type, const uint8_t *payload, uint8_t length) {
+    uint8_t frame[HOST_PAYLOAD_MAX + 5];
+
+    frame[0] = HOST_SYNC;
+    frame[1] = length;
+    frame[2] = sequence;
+    frame[3] = type;
+
+    uint8_t crc = crc8_update(crc8_update(crc8_update(0, length), sequence), type);
+
+    for (uint8_t i = 0; i < length; i++) {
+        frame[4 + i] = payload[i];
+        crc = crc8_update(crc, payload[i]);
+    }
+
+    frame[4 + length] = crc;
+
+    // Without space the host doesn't get an answer and retransmits
+    if (ring_push_block(&host_tx_ring, frame, length + 5)) {
+        IE2 |= UCA0TXIE;
+    }
+}
+
+void host_reply(uint8_t type, const uint8_t *payload, uint8_t length) {
+    if (length > HOST_PAYLOAD_MAX) {
+        length = HOST_PAYLOAD_MAX;
+    }
+
+    host_send(host_sequence, type, payload, length);
+
+    host_replied = true;
+}
+
+static void host_acknowledge(uint8_t sequence) {
+    uint8_t free = host_rx_ring.mask + 1 - ring_count(&host_rx_ring);
+
+    host_send(sequence, HOST_MESSAGE_ACK, &free, 1);
+}
+
+static void host_reject(uint8_t sequence, uint8_t reason) {
+    host_send(sequence, HOST_MESSAGE_NAK, &reason, 1);
+}
+
+static void host_handle_frame() {
+    uint8_t length = host_frame[0];
+    uint8_t sequence = host_frame[1];
+    uint8_t type = host_frame[2];
+
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < length + 3; i++) {
+        crc = crc8_update(crc, host_frame[i]);
+    }
+
+    if (crc != host_frame[length + 3]) {
+        if (host_stats.crc_errors < 0xffff) {
+            host_stats.crc_errors++;
+        }
+
+        host_reject(sequence, HOST_NAK_CRC);
+        return;
+    }
+
+    if (host_stats.frames < 0xffff) {
+        host_stats.frames++;
+    }
+
+    // Our answer got lost, the request was already executed. Statistics are sent again
+    if (host_last_sequence_valid && sequence == host_last_sequence
+        && type != HOST_MESSAGE_GET_STATS && type != HOST_MESSAGE_GET_HEALTH) {
+        host_acknowledge(sequence);
+        return;
+    }
+
+    host_last_sequence = sequence;
+    host_last_sequence_valid = true;
+
+    host_sequence = sequence;
+    host_replied = false;
+
+    if (!host_message_handler(type, &host_frame[3], length)) {
+        host_reject(sequence, HOST_NAK_INVALID);
+    } else if (!host_replied) {
+        host_acknowledge(sequence);
+    }
+}
+
+void host_poll() {
+    uint16_t overflows = host_rx_ring.overflows;
+
+    if (overflows != host_rx_overflows_seen) {
+        host_rx_overflows_seen = overflows;
+        host_stats.rx_overflows = overflows;
+
+        // Some bytes of the current frame are missing
+        host_parse_state = HOST_PARSE_SYNC;
+        host_reject(0, HOST_NAK_OVERFLOW);
+    }
+
+    if (host_parse_state != HOST_PARSE_SYNC && (uint16_t) (sched_ticks() - host_frame_start) > HOST_FRAME_TIMEOUT) {
+        host_parse_state = HOST_PARSE_SYNC;
+
+        if (host_stats.timeouts < 0xffff) {
+            host_stats.timeouts++;
+        }
+    }
+
+    uint8_t data;
+
+    while (ring_pop(&host_rx_ring, &data)) {
+        switch (host_parse_state) {
+            case HOST_PARSE_SYNC:
+                if (data == HOST_SYNC) {
+                    host_parse_state = HOST_PARSE_LENGTH;
+                    host_frame_start = sched_ticks();
+                }
+                break;
+            case HOST_PARSE_LENGTH:
+                if (data > HOST_PAYLOAD_MAX) {
+                    // Not a frame, look for the next sync byte
+                    host_parse_state = HOST_PARSE_SYNC;
+                    break;
+                }
+
+                host_frame[0] = data;
+                host_frame_fill = 1;
+                host_parse_state = HOST_PARSE_BODY;
+                break;
+            case HOST_PARSE_BODY:
+                host_frame[host_frame_fill] = data;
+                host_frame_fill++;
+
+                // Sequence, type, payload and crc are complete
+                if (host_frame_fill == host_frame[0] + 4) {
+                    host_parse_state = HOST_PARSE_SYNC;
+
+                    host_handle_frame();
+                }
+                break;
+        }
+    }
+}
+
+void host_get_stats(struct host_stats *stats) {
+    *stats = host_stats;
+}
+
+__attribute__((interrupt(USCIAB0RX_VECTOR)))
+void USCIAB0RX_ISR() {
+    if (IFG2 & UCA0RXIFG) {
+        // Counted as overflow if the ring is full
+        ring_push(&host_rx_ring, UCA0RXBUF);
+    }
+}
+
+__attribute__((interrupt(USCIAB0TX_VECTOR)))
+void USCIAB0TX_ISR() {
+    if ((IE2 & UCA0TXIE) && (IFG2 & UCA0TXIFG)) {
+        uint8_t data;
+
+        if (ring_pop(&host_tx_ring, &data)) {
+            UCA0TXBUF = data;
+        } else {
+            IE2 &= ~UCA0TXIE;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Binary control protocol on the UART (115200 baud, 8N1). Every frame is
+//   sync, length, sequence, type, payload ('length' bytes), crc
+//   with a CRC-8 (polynomial 0x07) over everything from 'length' to the payload.
+//   Every request is answered with ACK, NAK or a response of its own, which
+//   carry the request's sequence number. The ACK tells the host how much space
+//   is left in the receive buffer, so it can send several frames without waiting.
+//   A request with the same sequence number as the previous one is a retransmit,
+//   it is acknowledged but not executed again.
+
+#define HOST_SYNC 0xa5
+#define HOST_PAYLOAD_MAX 32
+
+// Requests
+
+// Payload: slave command. Extended commands are followed by their payload
+#define HOST_MESSAGE_COMMAND 0x01
+// Payload: on (0/1), brightness, speed, colour (packed 10:10:10, 32 bits, big endian)
+#define HOST_MESSAGE_SET_STATE 0x02
+// Output a colour directly, until another mode is selected
+// Payload: r, g, b (0-1023, 16 bits each, big endian)
+#define HOST_MESSAGE_STREAM_FRAME 0x03
+// Answered with HOST_MESSAGE_STATS
+#define HOST_MESSAGE_GET_STATS 0x04
+// Answered with HOST_MESSAGE_HEALTH
+#define HOST_MESSAGE_GET_HEALTH 0x05
+
+// Responses
+
+// Payload: free bytes in the receive buffer
+#define HOST_MESSAGE_ACK 0x80
+// Payload: HOST_NAK_* reason
+#define HOST_MESSAGE_NAK 0x81
+// Payload: awake percentage, then frames, CRC errors, receive overflows and timeouts
+//   (16 bits each, big endian), then the CPU share (1/256) and overruns (saturated
+//   to 255) of every scheduler task
+#define HOST_MESSAGE_STATS 0x84
+// Payload: the master's health counters, all STATS_REGISTER_* values in order
+//   (16 bits each, big endian)
+#define HOST_MESSAGE_HEALTH 0x85
+
+#define HOST_NAK_CRC 0x01
+// Unknown type or invalid payload
+#define HOST_NAK_INVALID 0x02
+// The receive buffer overflowed, bytes got lost. The sequence number is 0
+#define HOST_NAK_OVERFLOW 0x03
+
+struct host_stats {
+    // Frames with a valid CRC
+    uint16_t frames;
+    uint16_t crc_errors;
+    // Bytes dropped because the receive buffer was full
+    uint16_t rx_overflows;
+    // Partial frames dropped after a pause
+    uint16_t timeouts;
+};
+
+// The handler returns false if the request is invalid. If it doesn't send a
+//   response with host_reply() itself, the request is acknowledged
+void host_init(bool (*message_handler)(uint8_t type, const uint8_t *payload, uint8_t length));
+// Handles all received bytes, called regularly by the main loop
+void host_poll();
+// Answer the request that is being handled
+void host_reply(uint8_t type, const uint8_t *payload, uint8_t length);
+void host_get_stats(struct host_stats *stats);
@@ -7,14 +7,22 @@
 
 #include <shared/commands.h>
 #include <shared/i2c.h>
+#include <shared/flash.h>
 
-#ifndef NDEBUG
-#define LOGGING
+// Defines LOGGING if the debug log is built
 #include "uart.h"
+
+#ifdef HOST_LINK
+#include "host.h"
 #endif
 
 #include "rgb.h"
 #include "color.h"
+#include "animation.h"
+#include "sync.h"
+#include "sched.h"
+#include "state.h"
+#include "scene.h"
 
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof(*(array)))
 
@@ -22,41 +30,81 @@
 #define SPEED_MAX 63
 
 #define MAX_SLAVE_COUNT 16
-
-enum mode {
-    MODE_STATIC,
-    MODE_ANIMATED
-};
+// Range of non-reserved 7-bit I2C addresses
+#define SLAVE_ADDRESS_FIRST 0x08
+#define SLAVE_ADDRESS_LAST 0x77
 
 #include "colors.h"
+#include "waves.h"
 
 static bool is_on = true;
 
 static enum mode selected_mode = MODE_STATIC;
 static uint8_t selected_brightness = BRIGHTNESS_MAX;
 static uint8_t selected_speed = SPEED_MAX / 8;
-static uint8_t selected_color = 0;
+static uint32_t selected_color = COLOR(1023, 0, 0);
+// Animation or wave effect, kept for saving scenes
+static uint8_t selected_index = 0;
 
-static const struct color *animation_colors = NULL;
-static uint8_t animation_color_count = 0;
-static bool animation_smooth = false;
+static struct animation_state animation_state;
 
-static uint16_t animation_t = 0;
-static uint8_t animation_color_index = 0, animation_next_color_index = 1;
+static const struct wave_effect *wave_effect = NULL;
+static struct wave_channel wave_channels[WAVE_CHANNEL_COUNT];
 
 static volatile uint16_t unhandled_animation_steps = 0;
 
 static uint8_t slave_addresses[MAX_SLAVE_COUNT];
 static uint8_t slave_count = 0;
 
+// Health counters, saturating (see STATS_REGISTER_*)
+static struct {
+    uint16_t polls;
+    uint16_t polls_with_data;
+    uint16_t nacks;
+    uint16_t skipped_steps;
+} stats;
+
 static void discover_devices();
+static bool probe_address(uint8_t address);
+static void forget_device(uint8_t index);
+static void poll_task();
+static void animate_task();
+static void commit_task();
+#ifdef LOGGING
+static void log_task();
+#endif
+static void discovery_task();
+#ifdef HOST_LINK
+static void host_task();
+static bool handle_host_message(uint8_t type, const uint8_t *payload, uint8_t length);
+#endif
 static void update_static_color();
 static void animate();
 static void handle_command(uint8_t command);
-
-static uint16_t interp_1024(uint16_t a, uint16_t b, uint16_t t) {
-    return (uint32_t) ((uint32_t) a * (uint32_t) (1023 - t) + (uint32_t) b * t) / (uint32_t) 1023;
-}
+static void handle_extended_command(const uint8_t *payload, uint8_t length);
+static bool receive_bytes(uint8_t address, uint8_t *buffer, uint8_t length);
+static bool send_bytes(uint8_t address, const uint8_t *buffer, uint8_t length);
+static uint16_t read_stats_register(uint8_t reg);
+
+// Run-to-completion tasks, periods and deadlines in system ticks (64 us)
+static struct sched_task tasks[] = {
+    // One slave per run
+    { .run = poll_task, .period = 8, .deadline = 16 },
+    // New animation steps come every 128 ticks
+    { .run = animate_task, .period = 16, .deadline = 32 },
+    // Sending a WS2812 frame takes ~42 ticks
+    { .run = commit_task, .period = 16, .deadline = 64 },
+#ifdef HOST_LINK
+    // At 115200 baud the receive buffer is full after ~90 ticks
+    { .run = host_task, .period = 8, .deadline = 16 },
+#endif
+#ifdef LOGGING
+    // At 9600 baud a byte takes ~16 ticks
+    { .run = log_task, .period = 16, .deadline = 64 },
+#endif
+    // One address per run, a whole scan takes ~2 s
+    { .run = discovery_task, .period = 256, .deadline = 256 }
+};
 
 static void rgb_set_with_brightness(uint16_t r, uint16_t g, uint16_t b, uint8_t brightness) {
     rgb_set(
@@ -66,6 +114,40 @@ static void rgb_set_with_brightness(uint16_t r, uint16_t g, uint16_t b, uint8_t
     );
 }
 
+#ifdef RGB_BACKEND_WS2812
+// Bass red through treble blue
+static const uint8_t VISUALIZER_BAND_COLORS[VISUALIZER_BAND_COUNT][3] = {
+    { 255, 0, 0 },
+    { 255, 128, 0 },
+    { 255, 255, 0 },
+    { 0, 255, 0 },
+    { 0, 255, 255 },
+    { 0, 0, 255 }
+};
+
+// The beat flag of the last visualizer frame, the next bands flash at full brightness
+static bool visualizer_beat = false;
+
+// One bar per band: equally long sections of the strip, lit in proportion to the level
+static void show_visualizer_bands(const uint8_t *levels) {
+    uint8_t brightness = visualizer_beat ? BRIGHTNESS_MAX : selected_brightness;
+    uint16_t start = 0;
+
+    visualizer_beat = false;
+
+    for (uint8_t band = 0; band < VISUALIZER_BAND_COUNT; band++) {
+        uint16_t end = (RGB_PIXEL_COUNT * (band + 1)) / VISUALIZER_BAND_COUNT;
+        uint16_t lit = ((end - start) * levels[band] + 255) >> 8;
+        const uint8_t *color = VISUALIZER_BAND_COLORS[band];
+
+        rgb_set_pixels(start, lit, color_expand_10(color[0]), color_expand_10(color[1]), color_expand_10(color[2]), brightness);
+        rgb_set_pixels(start + lit, end - start - lit, 0, 0, 0, 0);
+
+        start = end;
+    }
+}
+#endif
+
 int main() {
     // Disable the watchdog timer
     WDTCTL = WDTPW | WDTHOLD;
@@ -80,15 +162,24 @@ int main() {
     // Configure P2.6 and P2.7 as normal GPIOs (they are configured as XIN and XOUT on reset)
     P2SEL = 0x00;
 
+    // Scenes are saved to flash
+    flash_init(40);
+
 #ifdef LOGGING
     uart_init();
 #endif
 
+#ifdef HOST_LINK
+    host_init(handle_host_message);
+#endif
+
     rgb_init();
 
+    sync_init();
+
     i2c_init_master();
 
-    // Enable timer interrupt for counting animation steps
+    // Enable the system tick interrupt
     TA0CTL |= TAIE;
 
     __enable_interrupt();
@@ -103,55 +194,258 @@ int main() {
 
     rgb_enable();
 
-    while (1) {
-        // Poll I2C slaves for commands
-        for (uint8_t i = 0; i < slave_count; i++) {
-            // Wait until STOP condition of previous transaction is generated
-            // TODO: use "repeated start" feature to speed up polling?
-            while (UCB0CTL1 & UCTXSTP);
+    sched_init(tasks, ARRAY_SIZE(tasks));
+    sched_run();
+}
 
-            UCB0I2CSA = slave_addresses[i];
+static void count(uint16_t *counter, uint16_t amount) {
+    uint16_t value = *counter + amount;
 
-            // Configure for receiver mode
-            UCB0CTL1 &= ~UCTR;
-            // Generate START condition
-            UCB0CTL1 |= UCTXSTT;
+    // Saturate instead of wrapping around
+    *counter = value < *counter ? 0xffff : value;
+}
 
-            // Wait until slave acknowledges address
-            while (UCB0CTL1 & UCTXSTT);
+static void poll_task() {
+    static uint8_t poll_index = 0;
 
-            // Slave didn't acknowledge address
-            if (UCB0STAT & UCNACKIFG) {
-                // Generate STOP condition
-                UCB0CTL1 |= UCTXSTP;
-                continue;
-            }
+    if (slave_count == 0) {
+        return;
+    }
 
-            // Generate STOP condition
-            UCB0CTL1 |= UCTXSTP;
+    // One slave per run, so that the other tasks don't wait for all of them
+    if (poll_index >= slave_count) {
+        poll_index = 0;
+    }
 
-            // Wait until data byte received
-            while (!(IFG2 & UCB0RXIFG));
+    uint8_t index = poll_index;
+    poll_index++;
 
-            uint8_t command = UCB0RXBUF;
+    uint8_t address = slave_addresses[index];
+    uint8_t command;
 
-            // The slave may not have a command for us
-            if (command != SLAVE_COMMAND_NONE) {
-                handle_command(command);
-            }
+    count(&stats.polls, 1);
+
+    // TODO: use "repeated start" feature to speed up polling?
+    if (!receive_bytes(address, &command, 1)) {
+        count(&stats.nacks, 1);
+
+        // The slave is gone, discovery adds it again once it is back
+        forget_device(index);
+        return;
+    }
+
+    if (command != SLAVE_COMMAND_NONE) {
+        count(&stats.polls_with_data, 1);
+    }
+
+    if ((command & 0xf8) == SLAVE_COMMAND_EXTENDED(0)) {
+        // The payload follows in a second transaction
+        uint8_t length = command & 0x07;
+        uint8_t payload[SLAVE_COMMAND_EXTENDED_MAX_LENGTH];
+
+        if (length == 0) {
+            return;
+        }
+
+        if (!receive_bytes(address, payload, length)) {
+            count(&stats.nacks, 1);
+            return;
         }
 
-        if (is_on) {
-            // Atomically read and clear the number of animation steps we will handle
-            __disable_interrupt();
-            uint16_t animation_steps = unhandled_animation_steps;
-            unhandled_animation_steps = 0;
-            __enable_interrupt();
+        if (payload[0] == EXTENDED_COMMAND_STATS_REQUEST) {
+            // Answered directly, only this slave gets the value
+            if (length >= 2) {
+                uint16_t value = read_stats_register(payload[1]);
+                uint8_t reply[] = { MASTER_COMMAND_STATS, payload[1], value >> 8, value };
 
-            for (uint16_t i = 0; i < animation_steps; i++) {
-                animate();
+                send_bytes(address, reply, sizeof(reply));
             }
+        } else {
+            handle_extended_command(payload, length);
+        }
+    } else if (command != SLAVE_COMMAND_NONE) {
+        // The slave may not have a command for us
+        handle_command(command);
+    }
+}
+
+static void animate_task() {
+    // Atomically read and clear the number of animation steps we will handle
+    __disable_interrupt();
+    uint16_t animation_steps = unhandled_animation_steps;
+    unhandled_animation_steps = 0;
+    __enable_interrupt();
+
+    // The tick keeps running while the lights are off, those steps are dropped
+    if (!is_on) {
+        return;
+    }
+
+    // Normally there is a single step, the others should have been handled by earlier runs
+    if (animation_steps > 1) {
+        count(&stats.skipped_steps, animation_steps - 1);
+    }
+
+    for (uint16_t i = 0; i < animation_steps; i++) {
+        animate();
+    }
+}
+
+static void commit_task() {
+    // Several steps or commands since the last run only output the last frame
+    rgb_commit();
+}
+
+#ifdef LOGGING
+static void log_task() {
+    struct sync_stats sync_stats;
+
+    if (sync_take_stats(&sync_stats)) {
+        uart_puts("sync: ");
+        uart_puthex(sync_stats.error_last);
+        uart_puts(" ");
+        uart_puthex(sync_stats.error_min);
+        uart_puts(" ");
+        uart_puthex(sync_stats.error_max);
+        uart_puts(" ");
+        uart_puthex(sync_stats.adjustment);
+        uart_puts(" ");
+        uart_puthex(sync_stats.jumps);
+        uart_puts("\r\n");
+    }
+
+    // Per task: CPU share in 1/256 (high byte) and overruns (low byte), then the awake percentage
+    if (sched_window_complete()) {
+        uart_puts("sched:");
+        for (uint8_t i = 0; i < ARRAY_SIZE(tasks); i++) {
+            uart_puts(" ");
+            uart_puthex(tasks[i].share << 8 | (tasks[i].overruns > 0xff ? 0xff : tasks[i].overruns));
         }
+        uart_puts(" ");
+        uart_puthex(sched_awake_percent());
+        uart_puts("\r\n");
+
+        // All STATS_REGISTER_* values in order
+        uart_puts("stats:");
+        for (uint8_t i = 0; i < STATS_REGISTER_COUNT; i++) {
+            uart_puts(" ");
+            uart_puthex(read_stats_register(i));
+        }
+        uart_puts("\r\n");
+    }
+
+    uart_flush();
+}
+#endif
+
+static void discovery_task() {
+    static uint8_t discovery_address = SLAVE_ADDRESS_FIRST;
+
+    uint8_t address = discovery_address;
+    discovery_address = address == SLAVE_ADDRESS_LAST ? SLAVE_ADDRESS_FIRST : address + 1;
+
+    // Known slaves aren't probed again: the read would take a command from their queue
+    for (uint8_t i = 0; i < slave_count; i++) {
+        if (slave_addresses[i] == address) {
+            return;
+        }
+    }
+
+    if (slave_count < MAX_SLAVE_COUNT && probe_address(address)) {
+        slave_addresses[slave_count] = address;
+        slave_count++;
+    }
+}
+
+// Read 'length' bytes from a slave, returns false if it didn't acknowledge its address
+static bool receive_bytes(uint8_t address, uint8_t *buffer, uint8_t length) {
+    // Wait until STOP condition of previous transaction is generated
+    while (UCB0CTL1 & UCTXSTP);
+
+    UCB0I2CSA = address;
+
+    // Configure for receiver mode
+    UCB0CTL1 &= ~UCTR;
+    // Generate START condition
+    UCB0CTL1 |= UCTXSTT;
+
+    // Wait until slave acknowledges address
+    while (UCB0CTL1 & UCTXSTT);
+
+    // Slave didn't acknowledge address
+    if (UCB0STAT & UCNACKIFG) {
+        // Generate STOP condition
+        UCB0CTL1 |= UCTXSTP;
+        return false;
+    }
+
+    for (uint8_t i = 0; i < length; i++) {
+        // Generate STOP condition while the last byte is being received
+        if (i == length - 1) {
+            UCB0CTL1 |= UCTXSTP;
+        }
+
+        // Wait until data byte received
+        while (!(IFG2 & UCB0RXIFG));
+
+        buffer[i] = UCB0RXBUF;
+    }
+
+    return true;
+}
+
+// Write 'length' (at least 1) bytes to a slave, returns false if it didn't acknowledge its address
+static bool send_bytes(uint8_t address, const uint8_t *buffer, uint8_t length) {
+    // Wait until STOP condition of previous transaction is generated
+    while (UCB0CTL1 & UCTXSTP);
+
+    UCB0I2CSA = address;
+
+    // Configure for transmitter mode and generate START condition
+    UCB0CTL1 |= UCTR | UCTXSTT;
+
+    // The first byte is buffered while the address is sent
+    while (!(IFG2 & UCB0TXIFG));
+    UCB0TXBUF = buffer[0];
+
+    // Wait until slave acknowledges address
+    while (UCB0CTL1 & UCTXSTT);
+
+    // Slave didn't acknowledge address
+    if (UCB0STAT & UCNACKIFG) {
+        // Generate STOP condition
+        UCB0CTL1 |= UCTXSTP;
+        return false;
+    }
+
+    for (uint8_t i = 1; i < length; i++) {
+        while (!(IFG2 & UCB0TXIFG));
+
+        UCB0TXBUF = buffer[i];
+    }
+
+    // Generate STOP condition once the last byte is being sent
+    while (!(IFG2 & UCB0TXIFG));
+
+    UCB0CTL1 |= UCTXSTP;
+
+    return true;
+}
+
+static uint16_t read_stats_register(uint8_t reg) {
+    struct sched_loop_stats loop_stats;
+    sched_get_loop_stats(&loop_stats);
+
+    switch (reg) {
+        case STATS_REGISTER_POLLS: return stats.polls;
+        case STATS_REGISTER_POLLS_WITH_DATA: return stats.polls_with_data;
+        case STATS_REGISTER_NACKS: return stats.nacks;
+        case STATS_REGISTER_SKIPPED_STEPS: return stats.skipped_steps;
+        case STATS_REGISTER_LOOP_RATE: return loop_stats.iterations;
+        case STATS_REGISTER_LOOP_MIN: return loop_stats.min_cycles;
+        case STATS_REGISTER_LOOP_MAX: return loop_stats.max_cycles;
+        case STATS_REGISTER_AWAKE: return sched_awake_percent();
+        default: return 0;
     }
 }
 
@@ -171,42 +465,50 @@ static void broadcast_master_command(uint8_t command) {
     UCB0CTL1 |= UCTXSTP;
 }
 
-static void discover_devices() {
-    for (uint8_t address = 0x08; address <= 0x77 && slave_count < MAX_SLAVE_COUNT; address++) {
-        // Wait until STOP condition of previous transaction is generated
-        while (UCB0CTL1 & UCTXSTP);
+// Returns true if a slave acknowledges the address
+static bool probe_address(uint8_t address) {
+    // Wait until STOP condition of previous transaction is generated
+    while (UCB0CTL1 & UCTXSTP);
 
-        UCB0I2CSA = address;
+    UCB0I2CSA = address;
 
-        // Configure for receiver mode
-        UCB0CTL1 &= ~UCTR;
-        // Generate START condition
-        UCB0CTL1 |= UCTXSTT;
+    // Configure for receiver mode
+    UCB0CTL1 &= ~UCTR;
+    // Generate START condition
+    UCB0CTL1 |= UCTXSTT;
 
-        // Wait until slave acknowledges address
-        while (UCB0CTL1 & UCTXSTT);
+    // Wait until slave acknowledges address
+    while (UCB0CTL1 & UCTXSTT);
 
-        // There is no slave with that address
-        if (UCB0STAT & UCNACKIFG) {
-            // Generate STOP condition
-            UCB0CTL1 |= UCTXSTP;
-            continue;
+    // Generate STOP condition
+    UCB0CTL1 |= UCTXSTP;
+
+    return !(UCB0STAT & UCNACKIFG);
+}
+
+static void discover_devices() {
+    for (uint8_t address = SLAVE_ADDRESS_FIRST; address <= SLAVE_ADDRESS_LAST && slave_count < MAX_SLAVE_COUNT; address++) {
+        if (probe_address(address)) {
+            // Add the slave to our list
+            slave_addresses[slave_count] = address;
+            slave_count++;
         }
+    }
+}
 
-        // Generate STOP condition
-        UCB0CTL1 |= UCTXSTP;
+static void forget_device(uint8_t index) {
+    slave_count--;
 
-        // Add the slave to our list
-        slave_addresses[slave_count] = address;
-        slave_count++;
+    for (uint8_t i = index; i < slave_count; i++) {
+        slave_addresses[i] = slave_addresses[i + 1];
     }
 }
 
 static void update_static_color() {
     rgb_set_with_brightness(
-        colors_static[selected_color].r,
-        colors_static[selected_color].g,
-        colors_static[selected_color].b,
+        COLOR_R(selected_color),
+        COLOR_G(selected_color),
+        COLOR_B(selected_color),
         selected_brightness
     );
 }
@@ -214,67 +516,76 @@ static void update_static_color() {
 static void animate() {
     switch (selected_mode) {
         case MODE_ANIMATED:
-            if (animation_smooth) {
-                animation_t += selected_speed + 1;
-                if (animation_t > 1023 * 4) {
-                    animation_t = 0;
-
-                    animation_color_index = animation_next_color_index;
-                    animation_next_color_index = (animation_color_index + 1) % animation_color_count;
-                }
-
-                uint16_t t_1024 = animation_t / 4;
-
-                rgb_set_with_brightness(
-                    interp_1024(animation_colors[animation_color_index].r, animation_colors[animation_next_color_index].r, t_1024),
-                    interp_1024(animation_colors[animation_color_index].g, animation_colors[animation_next_color_index].g, t_1024),
-                    interp_1024(animation_colors[animation_color_index].b, animation_colors[animation_next_color_index].b, t_1024),
-                    selected_brightness
-                );
-            } else {
-                animation_t += selected_speed * 4 + 1;
-                if (animation_t > 1023 * 4) {
-                    animation_t = 0;
-
-                    animation_color_index = animation_next_color_index;
-                    animation_next_color_index = (animation_color_index + 1) % animation_color_count;
-                }
-
-                rgb_set_with_brightness(
-                    animation_colors[animation_color_index].r,
-                    animation_colors[animation_color_index].g,
-                    animation_colors[animation_color_index].b,
-                    selected_brightness
-                );
-            }
+            animation_advance(&animation_state, selected_speed);
+
+            rgb_set_with_brightness(
+                animation_value(&animation_state, 0),
+                animation_value(&animation_state, 1),
+                animation_value(&animation_state, 2),
+                selected_brightness
+            );
+            break;
+        case MODE_WAVE:
+            rgb_set_with_brightness(
+                wave_step(&wave_channels[0]),
+                wave_step(&wave_channels[1]),
+                wave_step(&wave_channels[2]),
+                selected_brightness
+            );
             break;
         default:
             break;
     }
 }
 
-static void select_color(uint8_t index) {
+static void select_color(uint32_t color) {
     selected_mode = MODE_STATIC;
-    selected_color = index;
+    selected_color = color;
 
     update_static_color();
 
     broadcast_master_command(MASTER_COMMAND_ANIMATION_OFF);
 }
 
-static void select_animation(const struct color *colors, uint8_t color_count, bool smooth) {
+static void select_animation(const struct animation *animation) {
     selected_mode = MODE_ANIMATED;
-    animation_colors = colors;
-    animation_color_count = color_count;
-    animation_smooth = smooth;
+    selected_index = animation - animations;
 
-    animation_t = 0;
-    animation_color_index = 0;
-    animation_next_color_index = 1;
+    animation_start(&animation_state, animation);
 
     broadcast_master_command(MASTER_COMMAND_ANIMATION_ON);
 }
 
+static void update_wave_frequencies() {
+    uint16_t frequency = (selected_speed + 1) * WAVE_BASE_FREQUENCY;
+
+    for (uint8_t i = 0; i < WAVE_CHANNEL_COUNT; i++) {
+        wave_set_frequency(&wave_channels[i], (frequency * wave_effect->frequency_ratios[i]) >> 2);
+    }
+}
+
+static void select_wave(const struct wave_effect *effect) {
+    selected_mode = MODE_WAVE;
+    selected_index = effect - wave_effects;
+    wave_effect = effect;
+
+    for (uint8_t i = 0; i < WAVE_CHANNEL_COUNT; i++) {
+        wave_init(&wave_channels[i], effect->shape, effect->phase_offsets[i]);
+    }
+
+    update_wave_frequencies();
+
+    broadcast_master_command(MASTER_COMMAND_ANIMATION_ON);
+}
+
+static void select_visualizer() {
+    selected_mode = MODE_VISUALIZER;
+
+    // The brightness keys stay active, the visualizer slave starts sending frames
+    broadcast_master_command(MASTER_COMMAND_ANIMATION_OFF);
+    broadcast_master_command(MASTER_COMMAND_VISUALIZER_ON);
+}
+
 static void set_brightness(uint8_t brightness) {
     selected_brightness = brightness;
 
@@ -285,27 +596,23 @@ static void set_brightness(uint8_t brightness) {
 
 static void set_speed(uint8_t speed) {
     selected_speed = speed;
-}
 
-static void increment_brightness() {
-    if (selected_brightness < BRIGHTNESS_MAX) {
-        selected_brightness++;
-
-        if (selected_mode == MODE_STATIC) {
-            update_static_color();
-        }
+    if (selected_mode == MODE_WAVE) {
+        update_wave_frequencies();
     }
 }
 
-static void increment_speed() {
-    if (selected_speed < SPEED_MAX) {
-        selected_speed++;
+static void change_brightness(int8_t delta) {
+    int8_t brightness = selected_brightness + delta;
+
+    if (brightness < 1) {
+        brightness = 1;
+    } else if (brightness > BRIGHTNESS_MAX) {
+        brightness = BRIGHTNESS_MAX;
     }
-}
 
-static void decrement_brightness() {
-    if (selected_brightness > 1) {
-        selected_brightness--;
+    if (brightness != selected_brightness) {
+        selected_brightness = brightness;
 
         if (selected_mode == MODE_STATIC) {
             update_static_color();
@@ -313,9 +620,19 @@ static void decrement_brightness() {
     }
 }
 
-static void decrement_speed() {
-    if (selected_speed > 0) {
-        selected_speed--;
+static void change_speed(int8_t delta) {
+    int8_t speed = selected_speed + delta;
+
+    if (speed < 0) {
+        speed = 0;
+    } else if (speed > SPEED_MAX) {
+        speed = SPEED_MAX;
+    }
+
+    selected_speed = speed;
+
+    if (selected_mode == MODE_WAVE) {
+        update_wave_frequencies();
     }
 }
 
@@ -328,6 +645,7 @@ static void turn_on() {
 
     is_on = true;
 
+    sched_set_slow_tick(false);
     rgb_enable();
 
     __enable_interrupt();
@@ -342,11 +660,105 @@ static void turn_off() {
 
     is_on = false;
 
+    // Stops the LED timers, nothing needs the fast tick in the meantime
     rgb_disable();
+    sched_set_slow_tick(true);
 
     __enable_interrupt();
 }
 
+static void apply_state(const struct state *state) {
+    uint8_t fields = state->fields;
+
+    // Only stored here, the look or the update below outputs them
+    if (fields & APPLY_STATE_BRIGHTNESS) {
+        if (state->brightness < 1) {
+            selected_brightness = 1;
+        } else if (state->brightness > BRIGHTNESS_MAX) {
+            selected_brightness = BRIGHTNESS_MAX;
+        } else {
+            selected_brightness = state->brightness;
+        }
+    }
+    if (fields & APPLY_STATE_SPEED) {
+        selected_speed = state->speed > SPEED_MAX ? SPEED_MAX : state->speed;
+    }
+
+    bool selected = false;
+
+    if (fields & APPLY_STATE_LOOK) {
+        selected = true;
+
+        switch (state->mode) {
+            case MODE_STATIC:
+                select_color(state->color);
+                break;
+            case MODE_ANIMATED:
+                if (state->index < animation_count) {
+                    select_animation(&animations[state->index]);
+                } else {
+                    selected = false;
+                }
+                break;
+            case MODE_WAVE:
+                if (state->index < ARRAY_SIZE(wave_effects)) {
+                    select_wave(&wave_effects[state->index]);
+                } else {
+                    selected = false;
+                }
+                break;
+            case MODE_VISUALIZER:
+                select_visualizer();
+                break;
+            default:
+                selected = false;
+                break;
+        }
+    }
+
+    // The current look with the new brightness or speed
+    if (!selected && (fields & (APPLY_STATE_BRIGHTNESS | APPLY_STATE_SPEED))) {
+        if (selected_mode == MODE_STATIC) {
+            update_static_color();
+        } else if (selected_mode == MODE_WAVE) {
+            update_wave_frequencies();
+        }
+    }
+
+    if (fields & APPLY_STATE_ON) {
+        turn_on();
+    } else if (fields & APPLY_STATE_OFF) {
+        turn_off();
+    }
+}
+
+static void recall_scene(uint8_t index) {
+    struct state state;
+
+    if (scene_load(index, &state)) {
+        state.fields |= APPLY_STATE_ON;
+
+        apply_state(&state);
+    }
+}
+
+static void save_scene(uint8_t index) {
+    struct state state = {
+        .brightness = selected_brightness,
+        .speed = selected_speed,
+        .mode = selected_mode,
+        .index = selected_index,
+        .color = selected_color
+    };
+
+    // Streamed colours can't be recalled, the last static colour is saved instead
+    if (selected_mode == MODE_STREAM) {
+        state.mode = MODE_STATIC;
+    }
+
+    scene_save(index, &state);
+}
+
 static void handle_command(uint8_t command) {
 #ifdef LOGGING
     uart_puts("cmd: ");
@@ -358,22 +770,38 @@ static void handle_command(uint8_t command) {
     //   "mode changed to ANIMATED", "requested visualizer", ...
 
     switch (command) {
+        case SLAVE_COMMAND_TOGGLE: if (is_on) { turn_off(); } else { turn_on(); } break;
         case SLAVE_COMMAND_OFF: turn_off(); break;
         case SLAVE_COMMAND_ON: turn_on(); break;
-        case SLAVE_COMMAND_BRIGHTNESS_DECREMENT: decrement_brightness(); break;
-        case SLAVE_COMMAND_BRIGHTNESS_INCREMENT: increment_brightness(); break;
-        case SLAVE_COMMAND_SPEED_DECREMENT: decrement_speed(); break;
-        case SLAVE_COMMAND_SPEED_INCREMENT: increment_speed(); break;
+        case SLAVE_COMMAND_BRIGHTNESS_DECREMENT: change_brightness(-1); break;
+        case SLAVE_COMMAND_BRIGHTNESS_INCREMENT: change_brightness(1); break;
+        case SLAVE_COMMAND_SPEED_DECREMENT: change_speed(-1); break;
+        case SLAVE_COMMAND_SPEED_INCREMENT: change_speed(1); break;
         default:
             if ((command & 0xf0) == 0x10) {
                 switch (command & 0x0f) {
-                    case 0: select_animation(colors_flash, ARRAY_SIZE(colors_flash), false); break;
-                    case 1: select_animation(colors_strobe, ARRAY_SIZE(colors_strobe), false); break;
-                    case 2: select_animation(colors_fade, ARRAY_SIZE(colors_fade), true); break;
-                    case 3: select_animation(colors_smooth, ARRAY_SIZE(colors_smooth), true); break;
+                    case 0: select_animation(&animations[0]); break;
+                    case 1: select_animation(&animations[1]); break;
+                    case 2: select_animation(&animations[2]); break;
+                    case 3: select_animation(&animations[3]); break;
+                    case SLAVE_ANIMATION_VISUALIZER: select_visualizer(); break;
+                    default: {
+                        uint8_t wave_index = (command & 0x0f) - SLAVE_ANIMATION_WAVE_FIRST;
+
+                        if (wave_index < ARRAY_SIZE(wave_effects)) {
+                            select_wave(&wave_effects[wave_index]);
+                        }
+                        break;
+                    }
                 }
             } else if ((command & 0xe0) == 0x20) {
-                select_color(command & 0x1f);
+                if ((command & 0x1f) < ARRAY_SIZE(colors_static)) {
+                    select_color(colors_static[command & 0x1f]);
+                }
+            } else if ((command & 0xe0) == 0x40) {
+                change_brightness(SLAVE_COMMAND_DELTA_VALUE(command));
+            } else if ((command & 0xe0) == 0x60) {
+                change_speed(SLAVE_COMMAND_DELTA_VALUE(command));
             } else if ((command & 0xc0) == 0x80) {
                 set_brightness(command & 0x3f);
             } else if ((command & 0xc0) == 0xc0) {
@@ -382,17 +810,301 @@ static void handle_command(uint8_t command) {
     }
 }
 
+static void handle_extended_command(const uint8_t *payload, uint8_t length) {
+#ifdef LOGGING
+    uart_puts("ext: ");
+    uart_puthex(payload[0]);
+    uart_puts("\r\n");
+#endif
+
+    switch (payload[0]) {
+        case EXTENDED_COMMAND_VISUALIZER_FRAME:
+            if (length < 5 || selected_mode != MODE_VISUALIZER) {
+                break;
+            }
+
+#ifdef RGB_BACKEND_WS2812
+            // The strip shows the bands instead
+            if (payload[1] & VISUALIZER_FLAG_BEAT) {
+                visualizer_beat = true;
+            }
+#else
+            // Flash at full brightness on beats
+            rgb_set_with_brightness(
+                payload[2] << 2 | payload[2] >> 6,
+                payload[3] << 2 | payload[3] >> 6,
+                payload[4] << 2 | payload[4] >> 6,
+                (payload[1] & VISUALIZER_FLAG_BEAT) ? BRIGHTNESS_MAX : selected_brightness
+            );
+#endif
+            break;
+#ifdef RGB_BACKEND_WS2812
+        case EXTENDED_COMMAND_VISUALIZER_BANDS:
+            if (length < 1 + VISUALIZER_BAND_COUNT || selected_mode != MODE_VISUALIZER) {
+                break;
+            }
+
+            show_visualizer_bands(&payload[1]);
+            break;
+#endif
+        case EXTENDED_COMMAND_ANIMATION_SCRIPT:
+            if (length < 2 || payload[1] >= animation_count) {
+                break;
+            }
+
+            select_animation(&animations[payload[1]]);
+            break;
+        case EXTENDED_COMMAND_COLOR_PALETTE: {
+            if (length < 3) {
+                break;
+            }
+
+            uint16_t index = (uint16_t) payload[1] << 8 | payload[2];
+
+            if (index < COLOR_PALETTE_SIZE) {
+                select_color(color_palette(index));
+            }
+            break;
+        }
+        case EXTENDED_COMMAND_ZONES:
+            if (length < 2) {
+                break;
+            }
+
+            rgb_select_zones(payload[1]);
+
+            // Show the current colour on the newly selected zones right away
+            if (selected_mode == MODE_STATIC) {
+                update_static_color();
+            }
+            break;
+#ifdef RGB_BACKEND_WS2812
+        case EXTENDED_COMMAND_PIXEL: {
+            if (length < 7 || payload[6] > BRIGHTNESS_MAX) {
+                break;
+            }
+
+            // The pixels keep their colours until another mode is selected
+            if (selected_mode != MODE_STREAM) {
+                selected_mode = MODE_STREAM;
+
+                broadcast_master_command(MASTER_COMMAND_ANIMATION_OFF);
+            }
+
+            // The selected brightness dims all pixels on top of their own
+            rgb_set_pixel(
+                (uint16_t) payload[1] << 8 | payload[2],
+                color_expand_10(payload[3]),
+                color_expand_10(payload[4]),
+                color_expand_10(payload[5]),
+                (payload[6] * selected_brightness) / BRIGHTNESS_MAX
+            );
+            break;
+        }
+#endif
+        case EXTENDED_COMMAND_SLAVE_DUTY:
+#ifdef LOGGING
+            if (length < 3) {
+                break;
+            }
+
+            uart_puts("duty: ");
+            uart_puthex((uint16_t) payload[1] << 8 | payload[2]);
+            uart_puts("\r\n");
+#endif
+            break;
+        case EXTENDED_COMMAND_COLOR_HSV:
+            if (length < 5) {
+                break;
+            }
+
+            select_color(color_from_hsv((uint16_t) payload[1] << 8 | payload[2], payload[3], payload[4]));
+            break;
+        case EXTENDED_COMMAND_SCENE_RECALL:
+            if (length < 2) {
+                break;
+            }
+
+            recall_scene(payload[1]);
+            break;
+        case EXTENDED_COMMAND_SCENE_SAVE:
+            if (length < 2) {
+                break;
+            }
+
+            save_scene(payload[1]);
+            break;
+        case EXTENDED_COMMAND_APPLY_STATE: {
+            if (length < 7) {
+                break;
+            }
+
+            struct state state = {
+                .fields = payload[1],
+                .brightness = payload[2],
+                .speed = payload[3]
+            };
+
+            uint16_t value = (uint16_t) payload[5] << 8 | payload[6];
+
+            switch (payload[4]) {
+                case APPLY_STATE_LOOK_PALETTE:
+                    if (value < COLOR_PALETTE_SIZE) {
+                        state.mode = MODE_STATIC;
+                        state.color = color_palette(value);
+                    } else {
+                        state.fields &= ~APPLY_STATE_LOOK;
+                    }
+                    break;
+                case APPLY_STATE_LOOK_ANIMATION:
+                    state.mode = MODE_ANIMATED;
+                    state.index = value > 0xff ? 0xff : value;
+                    break;
+                case APPLY_STATE_LOOK_WAVE:
+                    state.mode = MODE_WAVE;
+                    state.index = value > 0xff ? 0xff : value;
+                    break;
+                case APPLY_STATE_LOOK_VISUALIZER:
+                    state.mode = MODE_VISUALIZER;
+                    break;
+                default:
+                    state.fields &= ~APPLY_STATE_LOOK;
+                    break;
+            }
+
+            apply_state(&state);
+            break;
+        }
+    }
+}
+
+#ifdef HOST_LINK
+static void host_task() {
+    host_poll();
+}
+
+static uint8_t put_u16(uint8_t *buffer, uint8_t index, uint16_t value) {
+    buffer[index] = value >> 8;
+    buffer[index + 1] = value;
+
+    return index + 2;
+}
+
+static void send_host_stats() {
+    uint8_t reply[HOST_PAYLOAD_MAX];
+    uint8_t length = 0;
+
+    struct host_stats host_stats;
+    host_get_stats(&host_stats);
+
+    reply[length++] = sched_awake_percent();
+    length = put_u16(reply, length, host_stats.frames);
+    length = put_u16(reply, length, host_stats.crc_errors);
+    length = put_u16(reply, length, host_stats.rx_overflows);
+    length = put_u16(reply, length, host_stats.timeouts);
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(tasks) && length + 2 <= HOST_PAYLOAD_MAX; i++) {
+        reply[length++] = tasks[i].share;
+        reply[length++] = tasks[i].overruns > 0xff ? 0xff : tasks[i].overruns;
+    }
+
+    host_reply(HOST_MESSAGE_STATS, reply, length);
+}
+
+static bool handle_host_message(uint8_t type, const uint8_t *payload, uint8_t length) {
+    switch (type) {
+        case HOST_MESSAGE_COMMAND:
+            if (length < 1) {
+                return false;
+            }
+
+            if ((payload[0] & 0xf8) == SLAVE_COMMAND_EXTENDED(0)) {
+                // Same layout as on the bus: the prefix holds the payload length
+                if (length < 2 || (payload[0] & 0x07) != length - 1) {
+                    return false;
+                }
+
+                handle_extended_command(payload + 1, length - 1);
+            } else {
+                handle_command(payload[0]);
+            }
+            return true;
+        case HOST_MESSAGE_SET_STATE: {
+            if (length < 7 || payload[1] < 1 || payload[1] > BRIGHTNESS_MAX || payload[2] > SPEED_MAX) {
+                return false;
+            }
+
+            uint32_t color = (uint32_t) payload[3] << 24 | (uint32_t) payload[4] << 16
+                | (uint32_t) payload[5] << 8 | payload[6];
+
+            // The two top bits aren't part of the colour
+            if (color & ~COLOR_MASK) {
+                return false;
+            }
+
+            struct state state = {
+                .fields = APPLY_STATE_BRIGHTNESS | APPLY_STATE_SPEED | APPLY_STATE_LOOK
+                    | (payload[0] ? APPLY_STATE_ON : APPLY_STATE_OFF),
+                .brightness = payload[1],
+                .speed = payload[2],
+                .mode = MODE_STATIC,
+                .color = color
+            };
+
+            apply_state(&state);
+            return true;
+        }
+        case HOST_MESSAGE_STREAM_FRAME: {
+            if (length < 6) {
+                return false;
+            }
+
+            uint16_t r = (uint16_t) payload[0] << 8 | payload[1];
+            uint16_t g = (uint16_t) payload[2] << 8 | payload[3];
+            uint16_t b = (uint16_t) payload[4] << 8 | payload[5];
+
+            if (r > 1023 || g > 1023 || b > 1023) {
+                return false;
+            }
+
+            if (selected_mode != MODE_STREAM) {
+                selected_mode = MODE_STREAM;
+
+                broadcast_master_command(MASTER_COMMAND_ANIMATION_OFF);
+            }
+
+            rgb_set_with_brightness(r, g, b, selected_brightness);
+            return true;
+        }
+        case HOST_MESSAGE_GET_STATS:
+            send_host_stats();
+            return true;
+        case HOST_MESSAGE_GET_HEALTH: {
+            uint8_t health[STATS_REGISTER_COUNT * 2];
+            uint8_t health_length = 0;
+
+            for (uint8_t i = 0; i < STATS_REGISTER_COUNT; i++) {
+                health_length = put_u16(health, health_length, read_stats_register(i));
+            }
+
+            host_reply(HOST_MESSAGE_HEALTH, health, health_length);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+#endif
+
 __attribute__((interrupt(TIMER0_A1_VECTOR)))
 void TIMER0_A1_ISR() {
     // Clear TAIFG
     TA0CTL &= ~TAIFG;
 
-    static uint8_t animation_steps_prescaler = 0;
-
-    animation_steps_prescaler++;
-    if (animation_steps_prescaler == 128) {
-        animation_steps_prescaler = 0;
+    unhandled_animation_steps += sync_tick(sched_tick_shift);
 
-        unhandled_animation_steps++;
+    if (sched_tick()) {
+        // A task is due, leave LPM0
+        __bic_SR_register_on_exit(LPM0_bits);
     }
 }
@@ -20,8 +20,9 @@ void rgb_init() {
     P2SEL &= ~(RGB_LED_R | RGB_LED_G | RGB_LED_B);
 
     // Initialize Timer_A0 for PWM generation
-    // SMCLK (16 MHz), stopped
-    TA0CTL = TASSEL_2;
+    // SMCLK (16 MHz), 'Up' mode. It keeps running while the outputs are
+    //   disabled since its overflow is the system tick
+    TA0CTL = TASSEL_2 | MC_1;
     TA0CCTL0 = 0;
     TA0CCTL1 = OUTMOD_7;
     TA0CCTL2 = 0;
@@ -50,8 +51,7 @@ void rgb_enable() {
         return;
     }
 
-    // Start the timers
-    TA0CTL |= MC_1;
+    // Start the timer
     TA1CTL |= MC_1;
 
     // Enable PWM outputs
@@ -66,8 +66,7 @@ void rgb_disable() {
         return;
     }
 
-    // Stop the timers
-    TA0CTL &= ~(MC0 | MC1);
+    // Stop the timer
     TA1CTL &= ~(MC0 | MC1);
 
     // Disable PWM outputs
@@ -76,6 +75,11 @@ void rgb_disable() {
     rgb_enabled = false;
 }
 
+void rgb_select_zones(uint8_t zones) {
+    // There is only one zone
+    (void) zones;
+}
+
 void rgb_set(uint16_t r, uint16_t g, uint16_t b) {
     // Correct for non-linear brightness of the LED
     uint16_t duty_cycle_r = RGB_PWM_LUT[r];
@@ -108,3 +112,7 @@ void rgb_set(uint16_t r, uint16_t g, uint16_t b) {
     TA1CCR1 = duty_cycle_g;
     TA1CCR2 = duty_cycle_b;
 }
+
+void rgb_commit() {
+    // The timers output new duty cycles by themselves
+}
@@ -1,4 +1,3 @@
-
 #pragma once
 
 #include <stdint.h>
@@ -7,9 +6,44 @@
 #define RGB_LED_G BIT1
 #define RGB_LED_B BIT4
 
+// Timer_A0 runs with this period from rgb_init() on, also while the outputs
+//   are disabled, and its overflow interrupt is the system tick (64 us)
 #define RGB_PWM_PERIOD 1024
 
+#if defined(RGB_BACKEND_BAM)
+// Independent RGB outputs of the bit-angle modulation back end (1-4)
+#ifndef RGB_ZONE_COUNT
+#define RGB_ZONE_COUNT 3
+#endif
+#elif defined(RGB_BACKEND_WS2812)
+// Length of the pixel strip (RGB_PIXEL_COUNT in CMakeLists.txt)
+#ifndef RGB_PIXEL_COUNT
+#define RGB_PIXEL_COUNT 60
+#endif
+// Equally long sections of the strip (1-8)
+#ifndef RGB_ZONE_COUNT
+#define RGB_ZONE_COUNT 1
+#endif
+#define RGB_PIXEL_BRIGHTNESS_MAX 63
+#else
+#define RGB_ZONE_COUNT 1
+#endif
+
+#define RGB_ZONES_ALL ((1 << RGB_ZONE_COUNT) - 1)
+
 void rgb_init();
 void rgb_disable();
 void rgb_enable();
+// rgb_set() only affects the selected zones (bit mask), the others keep their colour
+void rgb_select_zones(uint8_t zones);
 void rgb_set(uint16_t r, uint16_t g, uint16_t b);
+// Output the changes since the last call, only needed by back ends that don't refresh by themselves
+void rgb_commit();
+
+#ifdef RGB_BACKEND_WS2812
+// Colour (0-1023 per channel) and brightness (0-RGB_PIXEL_BRIGHTNESS_MAX) of a single
+//   pixel, regardless of the selected zones. The next rgb_set() overwrites it
+void rgb_set_pixel(uint16_t pixel, uint16_t r, uint16_t g, uint16_t b, uint8_t brightness);
+// The same for 'count' pixels from 'first' on
+void rgb_set_pixels(uint16_t first, uint16_t count, uint16_t r, uint16_t g, uint16_t b, uint8_t brightness);
+#endif
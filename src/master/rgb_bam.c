@@ -0,0 +1,219 @@
+#include "rgb.h"
+
+#include <msp430.h>
+#include <stdbool.h>
+
+// Bit-angle modulation: bit n of every channel's duty cycle is output for
+//   RGB_BAM_LSB_CYCLES * 2^n cycles. The timer interrupt only copies one
+//   precomputed port mask per port and bit, so its cost depends on the bit depth,
+//   but not on the number of channels.
+
+#if RGB_ZONE_COUNT < 1 || RGB_ZONE_COUNT > 4
+#error "The BAM back end supports 1 to 4 zones"
+#endif
+
+#define RGB_BAM_BITS 10
+// Shortest bit slot -> ~244 Hz @ 16 MHz
+#define RGB_BAM_LSB_CYCLES 64
+// Least time between setting up the next slot and its start, covers the rest of the interrupt
+#define RGB_BAM_MIN_LEAD_CYCLES 32
+
+#define RGB_CHANNEL_COUNT (RGB_ZONE_COUNT * 3)
+
+// Output pins: zone 0 on P2.0-P2.2, zone 1 on P2.3-P2.5, zone 2 on P2.6, P2.7, P1.0
+//   and zone 3 on P1.3-P1.5 (r, g, b each)
+static const uint8_t RGB_CHANNEL_PORTS[] = { 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1 };
+static const uint8_t RGB_CHANNEL_BITS[] = { BIT0, BIT1, BIT2, BIT3, BIT4, BIT5, BIT6, BIT7, BIT0, BIT3, BIT4, BIT5 };
+
+// The LED brightness does not scale linearly with the PWM duty cycle,
+//   so we map brightness values to PWM duty cycles using a pre-calculated
+//   quadratic function in the form a*x^2
+static const uint16_t RGB_PWM_LUT[] = {
+#include "RGB_PWM_LUT.txt"
+};
+
+// Bit n is output for 2^n slots, a table saves the interrupt a variable shift
+static const uint16_t RGB_BAM_SLOT_CYCLES[RGB_BAM_BITS] = {
+    RGB_BAM_LSB_CYCLES << 0, RGB_BAM_LSB_CYCLES << 1, RGB_BAM_LSB_CYCLES << 2, RGB_BAM_LSB_CYCLES << 3,
+    RGB_BAM_LSB_CYCLES << 4, RGB_BAM_LSB_CYCLES << 5, RGB_BAM_LSB_CYCLES << 6, RGB_BAM_LSB_CYCLES << 7,
+    RGB_BAM_LSB_CYCLES << 8, RGB_BAM_LSB_CYCLES << 9
+};
+
+struct rgb_bam_masks {
+    uint8_t p1[RGB_BAM_BITS];
+    uint8_t p2[RGB_BAM_BITS];
+};
+
+// The interrupt outputs the front buffer while rgb_set() fills the back buffer.
+//   They are swapped at the end of a BAM cycle
+static struct rgb_bam_masks rgb_bam_buffers[2];
+static struct rgb_bam_masks *volatile rgb_bam_front = &rgb_bam_buffers[0];
+static volatile bool rgb_bam_swap_pending = false;
+
+static uint8_t rgb_bam_p1_pins = 0, rgb_bam_p2_pins = 0;
+static uint8_t rgb_bam_bit = 0;
+
+static uint16_t rgb_duty_cycles[RGB_CHANNEL_COUNT];
+static uint8_t rgb_selected_zones = RGB_ZONES_ALL;
+
+static bool rgb_enabled = false;
+
+void rgb_init() {
+    rgb_bam_p1_pins = 0;
+    rgb_bam_p2_pins = 0;
+
+    for (uint8_t i = 0; i < RGB_CHANNEL_COUNT; i++) {
+        if (RGB_CHANNEL_PORTS[i] == 1) {
+            rgb_bam_p1_pins |= RGB_CHANNEL_BITS[i];
+        } else {
+            rgb_bam_p2_pins |= RGB_CHANNEL_BITS[i];
+        }
+
+        rgb_duty_cycles[i] = 0;
+    }
+
+    // RGB LEDs off initially
+    P1DIR |= rgb_bam_p1_pins;
+    P1OUT &= ~rgb_bam_p1_pins;
+    P1SEL &= ~rgb_bam_p1_pins;
+    P2DIR |= rgb_bam_p2_pins;
+    P2OUT &= ~rgb_bam_p2_pins;
+    P2SEL &= ~rgb_bam_p2_pins;
+
+    for (uint8_t b = 0; b < RGB_BAM_BITS; b++) {
+        rgb_bam_buffers[0].p1[b] = 0;
+        rgb_bam_buffers[0].p2[b] = 0;
+    }
+    rgb_bam_front = &rgb_bam_buffers[0];
+    rgb_bam_swap_pending = false;
+
+    // Timer_A0 only provides the system tick with this back end
+    // SMCLK (16 MHz), 'Up' mode
+    TA0CTL = TASSEL_2 | MC_1;
+    TA0CCTL0 = 0;
+    TA0CCTL1 = 0;
+    TA0CCTL2 = 0;
+    TA0CCR0 = RGB_PWM_PERIOD - 1;
+
+    // Initialize Timer_A1 for BAM
+    // SMCLK (16 MHz), stopped
+    TA1CTL = TASSEL_2;
+    TA1CCTL0 = 0;
+    TA1CCTL1 = 0;
+    TA1CCTL2 = 0;
+
+    rgb_enabled = false;
+}
+
+void rgb_enable() {
+    if (rgb_enabled) {
+        return;
+    }
+
+    rgb_bam_bit = 0;
+
+    // Start the timer, first BAM slot right away
+    TA1CTL |= TACLR;
+    TA1CCR0 = RGB_BAM_LSB_CYCLES;
+    TA1CCTL0 = CCIE;
+    TA1CTL |= MC_2;
+
+    rgb_enabled = true;
+}
+
+void rgb_disable() {
+    if (!rgb_enabled) {
+        return;
+    }
+
+    // Stop the timer
+    TA1CTL &= ~(MC0 | MC1);
+    TA1CCTL0 = 0;
+
+    // Outputs off
+    P1OUT &= ~rgb_bam_p1_pins;
+    P2OUT &= ~rgb_bam_p2_pins;
+
+    rgb_enabled = false;
+}
+
+void rgb_select_zones(uint8_t zones) {
+    rgb_selected_zones = zones & RGB_ZONES_ALL;
+}
+
+void rgb_set(uint16_t r, uint16_t g, uint16_t b) {
+    // Correct for non-linear brightness of the LED
+    uint16_t duty_cycle_r = RGB_PWM_LUT[r];
+    uint16_t duty_cycle_g = RGB_PWM_LUT[g];
+    uint16_t duty_cycle_b = RGB_PWM_LUT[b];
+
+    for (uint8_t zone = 0; zone < RGB_ZONE_COUNT; zone++) {
+        if (rgb_selected_zones & (1 << zone)) {
+            rgb_duty_cycles[zone * 3] = duty_cycle_r;
+            rgb_duty_cycles[zone * 3 + 1] = duty_cycle_g;
+            rgb_duty_cycles[zone * 3 + 2] = duty_cycle_b;
+        }
+    }
+
+    // Make sure the interrupt doesn't swap while we are writing the back buffer
+    rgb_bam_swap_pending = false;
+
+    struct rgb_bam_masks *back = (rgb_bam_front == &rgb_bam_buffers[0]) ? &rgb_bam_buffers[1] : &rgb_bam_buffers[0];
+
+    for (uint8_t bit = 0; bit < RGB_BAM_BITS; bit++) {
+        uint16_t bit_mask = 1 << bit;
+        uint8_t p1 = 0, p2 = 0;
+
+        for (uint8_t i = 0; i < RGB_CHANNEL_COUNT; i++) {
+            if (rgb_duty_cycles[i] & bit_mask) {
+                if (RGB_CHANNEL_PORTS[i] == 1) {
+                    p1 |= RGB_CHANNEL_BITS[i];
+                } else {
+                    p2 |= RGB_CHANNEL_BITS[i];
+                }
+            }
+        }
+
+        back->p1[bit] = p1;
+        back->p2[bit] = p2;
+    }
+
+    rgb_bam_swap_pending = true;
+}
+
+__attribute__((interrupt(TIMER1_A0_VECTOR)))
+void TIMER1_A0_ISR() {
+    uint8_t bit = rgb_bam_bit;
+    const struct rgb_bam_masks *masks = rgb_bam_front;
+
+    P1OUT = (P1OUT & ~rgb_bam_p1_pins) | masks->p1[bit];
+    P2OUT = (P2OUT & ~rgb_bam_p2_pins) | masks->p2[bit];
+
+    uint16_t next = TA1CCR0 + RGB_BAM_SLOT_CYCLES[bit];
+
+    // The interrupt started so late (other interrupts, flash erases with interrupts
+    //   disabled) that the next slot would already be over. Its compare value would
+    //   only match after the timer wrapped around (~4 ms), so the slot is shortened instead
+    if ((int16_t) (next - TA1R) < RGB_BAM_MIN_LEAD_CYCLES) {
+        next = TA1R + RGB_BAM_MIN_LEAD_CYCLES;
+    }
+
+    TA1CCR0 = next;
+
+    bit++;
+    if (bit == RGB_BAM_BITS) {
+        bit = 0;
+
+        // Only swap between cycles so that no cycle mixes old and new values
+        if (rgb_bam_swap_pending) {
+            rgb_bam_front = (rgb_bam_front == &rgb_bam_buffers[0]) ? &rgb_bam_buffers[1] : &rgb_bam_buffers[0];
+            rgb_bam_swap_pending = false;
+        }
+    }
+
+    rgb_bam_bit = bit;
+}
+
+void rgb_commit() {
+    // The buffers are swapped by the interrupt
+}
@@ -0,0 +1,197 @@
+#include "rgb.h"
+
+#include <msp430.h>
+#include <stdbool.h>
+
+// WS2812 pixel strip on USCI_A0 in SPI mode. Every data bit is sent as 3 SPI bits
+//   (0 -> 100, 1 -> 110) at SMCLK / 6 = 2.67 MHz, i.e. 375 ns per SPI bit and
+//   1.125 us per data bit. A byte expands to exactly 3 SPI bytes, which are looked
+//   up in a pre-computed table, so sending a frame is a plain copy loop.
+//   100 pixels take ~2.7 ms -> well above 60 frames per second.
+
+#if RGB_ZONE_COUNT < 1 || RGB_ZONE_COUNT > 8
+#error "The WS2812 back end supports 1 to 8 zones"
+#endif
+
+#if RGB_PIXEL_COUNT < RGB_ZONE_COUNT
+#error "Every zone needs at least one pixel"
+#endif
+
+// Data input of the strip (UCA0SIMO)
+#define RGB_WS2812_DATA BIT2
+
+#define RGB_WS2812_SPI_DIVIDER 6
+
+// The LED brightness does not scale linearly with the PWM duty cycle,
+//   so we map brightness values to PWM duty cycles using a pre-calculated
+//   quadratic function in the form a*x^2
+static const uint16_t RGB_PWM_LUT[] = {
+#include "RGB_PWM_LUT.txt"
+};
+
+// The 3 SPI bytes for each data byte, most significant first
+static const uint8_t RGB_WS2812_LUT[256 * 3] = {
+#include "WS2812_LUT.txt"
+};
+
+// Pixels in the order the strip expects them: green, red, blue
+static uint8_t rgb_pixels[RGB_PIXEL_COUNT][3];
+static bool rgb_pixels_changed = false;
+
+static uint8_t rgb_selected_zones = RGB_ZONES_ALL;
+
+static bool rgb_enabled = false;
+
+// Brightness, then gamma correction with the PWM table, reduced to the 8 bits of the strip
+static uint8_t rgb_ws2812_level(uint16_t value, uint8_t brightness) {
+    return RGB_PWM_LUT[(uint16_t) (value * brightness) / RGB_PIXEL_BRIGHTNESS_MAX] >> 2;
+}
+
+static void rgb_ws2812_send(bool blank) {
+    const uint8_t *data = &rgb_pixels[0][0];
+
+    for (uint16_t i = 0; i < RGB_PIXEL_COUNT * 3; i++) {
+        const uint8_t *code = &RGB_WS2812_LUT[blank ? 0 : data[i] * 3];
+
+        while (!(IFG2 & UCA0TXIFG));
+        UCA0TXBUF = code[0];
+        while (!(IFG2 & UCA0TXIFG));
+        UCA0TXBUF = code[1];
+        while (!(IFG2 & UCA0TXIFG));
+        UCA0TXBUF = code[2];
+    }
+
+    // The line stays low after the last bit, which latches the data once the
+    //   strip sees more than 50 us of it. The next frame comes much later anyway
+    while (UCA0STAT & UCBUSY);
+}
+
+void rgb_init() {
+    for (uint16_t i = 0; i < RGB_PIXEL_COUNT; i++) {
+        rgb_pixels[i][0] = 0;
+        rgb_pixels[i][1] = 0;
+        rgb_pixels[i][2] = 0;
+    }
+    rgb_pixels_changed = false;
+
+    // Enter reset state
+    UCA0CTL1 = UCSWRST;
+
+    // SPI master, 3-pin, MSB first, data changes on the falling edge
+    UCA0CTL0 = UCCKPH | UCMSB | UCMST | UCMODE_0 | UCSYNC;
+    // SMCLK
+    UCA0CTL1 |= UCSSEL_2;
+    UCA0BR0 = RGB_WS2812_SPI_DIVIDER;
+    UCA0BR1 = 0;
+
+    // Only the data output is needed, the clock pin stays a GPIO
+    P1OUT &= ~RGB_WS2812_DATA;
+    P1SEL |= RGB_WS2812_DATA;
+    P1SEL2 |= RGB_WS2812_DATA;
+
+    // Release USCI reset
+    UCA0CTL1 &= ~UCSWRST;
+
+    // Timer_A0 only provides the system tick with this back end
+    // SMCLK (16 MHz), 'Up' mode
+    TA0CTL = TASSEL_2 | MC_1;
+    TA0CCTL0 = 0;
+    TA0CCTL1 = 0;
+    TA0CCTL2 = 0;
+    TA0CCR0 = RGB_PWM_PERIOD - 1;
+
+    // The strip may show garbage after power up
+    rgb_ws2812_send(true);
+
+    rgb_enabled = false;
+}
+
+void rgb_enable() {
+    if (rgb_enabled) {
+        return;
+    }
+
+    rgb_enabled = true;
+    rgb_pixels_changed = true;
+}
+
+void rgb_disable() {
+    if (!rgb_enabled) {
+        return;
+    }
+
+    rgb_enabled = false;
+
+    // The framebuffer is kept for turning back on
+    rgb_ws2812_send(true);
+}
+
+void rgb_select_zones(uint8_t zones) {
+    rgb_selected_zones = zones & RGB_ZONES_ALL;
+}
+
+void rgb_set(uint16_t r, uint16_t g, uint16_t b) {
+    // Gamma correction with the PWM table, reduced to the 8 bits of the strip
+    uint8_t pixel_g = RGB_PWM_LUT[g] >> 2;
+    uint8_t pixel_r = RGB_PWM_LUT[r] >> 2;
+    uint8_t pixel_b = RGB_PWM_LUT[b] >> 2;
+
+    // Zones are equally long sections of the strip
+    uint16_t start = 0;
+
+    for (uint8_t zone = 0; zone < RGB_ZONE_COUNT; zone++) {
+        uint16_t end = (RGB_PIXEL_COUNT * (zone + 1)) / RGB_ZONE_COUNT;
+
+        if (rgb_selected_zones & (1 << zone)) {
+            for (uint16_t i = start; i < end; i++) {
+                rgb_pixels[i][0] = pixel_g;
+                rgb_pixels[i][1] = pixel_r;
+                rgb_pixels[i][2] = pixel_b;
+            }
+        }
+
+        start = end;
+    }
+
+    rgb_pixels_changed = true;
+}
+
+void rgb_set_pixel(uint16_t pixel, uint16_t r, uint16_t g, uint16_t b, uint8_t brightness) {
+    rgb_set_pixels(pixel, 1, r, g, b, brightness);
+}
+
+void rgb_set_pixels(uint16_t first, uint16_t count, uint16_t r, uint16_t g, uint16_t b, uint8_t brightness) {
+    if (first >= RGB_PIXEL_COUNT) {
+        return;
+    }
+
+    if (count > RGB_PIXEL_COUNT - first) {
+        count = RGB_PIXEL_COUNT - first;
+    }
+
+    if (brightness > RGB_PIXEL_BRIGHTNESS_MAX) {
+        brightness = RGB_PIXEL_BRIGHTNESS_MAX;
+    }
+
+    uint8_t pixel_g = rgb_ws2812_level(g, brightness);
+    uint8_t pixel_r = rgb_ws2812_level(r, brightness);
+    uint8_t pixel_b = rgb_ws2812_level(b, brightness);
+
+    for (uint16_t i = first; i < first + count; i++) {
+        rgb_pixels[i][0] = pixel_g;
+        rgb_pixels[i][1] = pixel_r;
+        rgb_pixels[i][2] = pixel_b;
+    }
+
+    rgb_pixels_changed = true;
+}
+
+void rgb_commit() {
+    if (!rgb_enabled || !rgb_pixels_changed) {
+        return;
+    }
+
+    rgb_pixels_changed = false;
+
+    rgb_ws2812_send(false);
+}
@@ -0,0 +1,112 @@
+#include "scene.h"
+
+#include <string.h>
+
+#include <shared/flash.h>
+
+#include "color.h"
+
+#define SCENE_EMPTY 0xff
+
+struct scene_record {
+    uint8_t mode;
+    uint8_t index;
+    uint8_t brightness;
+    uint8_t speed;
+    uint32_t color;
+};
+
+#define SCENE_RECORD_ERASED { SCENE_EMPTY, 0xff, 0xff, 0xff, 0xffffffffUL }
+
+// Erased flash reads as SCENE_EMPTY, the slot's default is used then. The image
+//   holds erased slots as well: without an initializer the section would be
+//   flashed with zeros, which looks like a saved black scene.
+//   Volatile because the compiler must not assume the slots keep their initial contents
+static const volatile struct scene_record scene_slots[SCENE_COUNT]
+    __attribute__((section(".infoB"), aligned(FLASH_INFO_SEGMENT_SIZE))) = {
+    [0 ... SCENE_COUNT - 1] = SCENE_RECORD_ERASED
+};
+
+static const struct scene_record scene_defaults[SCENE_COUNT] = {
+    // Warm white
+    { MODE_STATIC, 0, 48, 0, COLOR(1023, 640, 256) },
+    // Night light
+    { MODE_STATIC, 0, 4, 0, COLOR(1023, 128, 0) },
+    // Cold white
+    { MODE_STATIC, 0, 63, 0, COLOR(768, 896, 1023) },
+    // Slow rainbow wave
+    { MODE_WAVE, 1, 40, 2, 0 },
+    // Breathing
+    { MODE_WAVE, 0, 63, 8, 0 },
+    { MODE_ANIMATED, 0, 63, 8, 0 },
+    { MODE_ANIMATED, 1, 63, 16, 0 },
+    { MODE_VISUALIZER, 0, 48, 0, 0 }
+};
+
+static void scene_read(uint8_t index, struct scene_record *record) {
+    const volatile uint8_t *src = (const volatile uint8_t *) &scene_slots[index];
+    uint8_t *dest = (uint8_t *) record;
+
+    for (uint8_t i = 0; i < sizeof(*record); i++) {
+        dest[i] = src[i];
+    }
+}
+
+bool scene_load(uint8_t index, struct state *state) {
+    if (index >= SCENE_COUNT) {
+        return false;
+    }
+
+    struct scene_record record;
+
+    if (scene_slots[index].mode == SCENE_EMPTY) {
+        record = scene_defaults[index];
+    } else {
+        scene_read(index, &record);
+    }
+
+    state->fields = APPLY_STATE_BRIGHTNESS | APPLY_STATE_SPEED | APPLY_STATE_LOOK;
+    state->mode = record.mode;
+    state->index = record.index;
+    state->brightness = record.brightness;
+    state->speed = record.speed;
+    state->color = record.color;
+
+    return true;
+}
+
+void scene_save(uint8_t index, const struct state *state) {
+    if (index >= SCENE_COUNT) {
+        return;
+    }
+
+    struct scene_record record = {
+        .mode = state->mode,
+        .index = state->index,
+        .brightness = state->brightness,
+        .speed = state->speed,
+        .color = state->color
+    };
+
+    if (scene_slots[index].mode == SCENE_EMPTY) {
+        flash_write((const void *) &scene_slots[index], &record, sizeof(record));
+        return;
+    }
+
+    // Bits can only be cleared by writing, the whole segment has to be erased
+    struct scene_record records[SCENE_COUNT];
+
+    for (uint8_t i = 0; i < SCENE_COUNT; i++) {
+        scene_read(i, &records[i]);
+    }
+
+    if (memcmp(&records[index], &record, sizeof(record)) == 0) {
+        // Nothing changed, spare the flash an erase cycle
+        return;
+    }
+
+    records[index] = record;
+
+    flash_erase((const void *) scene_slots);
+    flash_write((const void *) scene_slots, records, sizeof(records));
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "state.h"
+
+// Scenes are complete looks (mode, colour or effect, brightness, speed) stored in
+//   information memory segment B. Scenes that were never saved have defaults
+
+#define SCENE_COUNT 8
+
+// Fills in brightness, speed and look and sets the corresponding fields,
+//   returns false if the index is out of range
+bool scene_load(uint8_t index, struct state *state);
+// Erases and rewrites the segment if the scene's slot was used before (~13 ms with interrupts disabled)
+void scene_save(uint8_t index, const struct state *state);
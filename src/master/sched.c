@@ -0,0 +1,246 @@
+#include "sched.h"
+
+#include <msp430.h>
+#include <stddef.h>
+
+#include "rgb.h"
+
+static struct sched_task *sched_tasks = NULL;
+static uint8_t sched_task_count = 0;
+
+volatile uint8_t sched_tick_shift = 0;
+
+static volatile uint16_t sched_tick_count = 0;
+// The tick interrupt wakes the CPU once this tick is reached
+static volatile uint16_t sched_wake_tick = 0;
+static volatile bool sched_sleeping = false;
+
+static uint32_t sched_window_start = 0;
+static uint32_t sched_idle_cycles = 0;
+static uint8_t sched_awake_percent_value = 100;
+static bool sched_window_done = false;
+
+static struct sched_loop_stats sched_loop_window = { 0, 0xffff, 0 };
+static struct sched_loop_stats sched_loop_last = { 0, 0, 0 };
+
+void sched_init(struct sched_task *tasks, uint8_t task_count) {
+    sched_tasks = tasks;
+    sched_task_count = task_count;
+
+    uint16_t now = sched_ticks();
+
+    for (uint8_t i = 0; i < task_count; i++) {
+        tasks[i].release = now;
+        tasks[i].overruns = 0;
+        tasks[i].max_cycles = 0;
+        tasks[i].window_cycles = 0;
+        tasks[i].share = 0;
+    }
+
+    sched_window_start = sched_cycles();
+    sched_idle_cycles = 0;
+}
+
+void sched_set_slow_tick(bool slow) {
+    uint8_t shift = slow ? 3 : 0;
+
+    if (shift == sched_tick_shift) {
+        return;
+    }
+
+    // The divider may only be changed while the timer is stopped, TACLR resets it.
+    //   The part of the current tick that already passed is lost
+    uint16_t mode = TA0CTL & (MC0 | MC1);
+    TA0CTL &= ~(MC0 | MC1 | ID0 | ID1);
+    TA0CTL |= (slow ? ID_3 : ID_0) | TACLR;
+    TA0CTL |= mode;
+
+    sched_tick_shift = shift;
+}
+
+bool sched_tick() {
+    uint16_t ticks = sched_tick_count + (1 << sched_tick_shift);
+    sched_tick_count = ticks;
+
+    if (sched_sleeping && (int16_t) (ticks - sched_wake_tick) >= 0) {
+        sched_sleeping = false;
+        return true;
+    }
+
+    return false;
+}
+
+uint16_t sched_ticks() {
+    return sched_tick_count;
+}
+
+uint32_t sched_cycles() {
+    __disable_interrupt();
+
+    uint16_t ticks = sched_tick_count;
+    uint16_t count = TA0R;
+
+    // The timer overflowed, but the interrupt hasn't counted it yet
+    if ((TA0CTL & TAIFG) && count < RGB_PWM_PERIOD / 2) {
+        ticks += 1 << sched_tick_shift;
+    }
+
+    __enable_interrupt();
+
+    return ((uint32_t) ticks * RGB_PWM_PERIOD + ((uint32_t) count << sched_tick_shift)) & SCHED_CYCLES_MASK;
+}
+
+static void sched_update_window() {
+    uint32_t now = sched_cycles();
+
+    if (((now - sched_window_start) & SCHED_CYCLES_MASK) < SCHED_WINDOW_CYCLES) {
+        return;
+    }
+
+    sched_window_start = now;
+
+    for (uint8_t i = 0; i < sched_task_count; i++) {
+        struct sched_task *task = &sched_tasks[i];
+
+        uint32_t share = task->window_cycles >> SCHED_SHARE_SHIFT;
+        task->share = share > 0xff ? 0xff : share;
+        task->window_cycles = 0;
+    }
+
+    // The window is only checked between tasks, so it may be a bit longer
+    uint32_t idle_percent = (sched_idle_cycles * 100) / SCHED_WINDOW_CYCLES;
+    sched_awake_percent_value = idle_percent >= 100 ? 0 : 100 - idle_percent;
+    sched_idle_cycles = 0;
+
+    sched_loop_last = sched_loop_window;
+    if (sched_loop_last.iterations == 0) {
+        sched_loop_last.min_cycles = 0;
+    }
+
+    sched_loop_window.iterations = 0;
+    sched_loop_window.min_cycles = 0xffff;
+    sched_loop_window.max_cycles = 0;
+
+    sched_window_done = true;
+}
+
+static void sched_run_task(struct sched_task *task) {
+    uint16_t release = task->release;
+
+    uint32_t start = sched_cycles();
+    task->run();
+    uint32_t cycles = (sched_cycles() - start) & SCHED_CYCLES_MASK;
+
+    uint16_t now = sched_ticks();
+
+    task->window_cycles += cycles;
+    if (cycles > task->max_cycles) {
+        task->max_cycles = cycles > 0xffff ? 0xffff : cycles;
+    }
+
+    if ((int16_t) (now - release) > (int16_t) task->deadline && task->overruns < 0xffff) {
+        task->overruns++;
+    }
+
+    // A task that fell behind by more than a period skips the releases it missed
+    release += task->period;
+    while ((int16_t) (now - release) >= (int16_t) task->period) {
+        release += task->period;
+
+        if (task->overruns < 0xffff) {
+            task->overruns++;
+        }
+    }
+
+    task->release = release;
+}
+
+static void sched_count_iteration(uint32_t cycles) {
+    uint16_t saturated = cycles > 0xffff ? 0xffff : cycles;
+
+    if (sched_loop_window.iterations < 0xffff) {
+        sched_loop_window.iterations++;
+    }
+    if (saturated < sched_loop_window.min_cycles) {
+        sched_loop_window.min_cycles = saturated;
+    }
+    if (saturated > sched_loop_window.max_cycles) {
+        sched_loop_window.max_cycles = saturated;
+    }
+}
+
+static void sched_sleep(uint16_t wake_tick) {
+    uint32_t start = sched_cycles();
+
+    __disable_interrupt();
+
+    // The tick may already have passed while we were looking at the tasks
+    if ((int16_t) (sched_tick_count - wake_tick) < 0) {
+        sched_wake_tick = wake_tick;
+        sched_sleeping = true;
+
+        // Enable interrupts and enter LPM0 at once, the tick interrupt wakes us up
+        __bis_SR_register(LPM0_bits | GIE);
+    }
+
+    __enable_interrupt();
+
+    sched_idle_cycles += (sched_cycles() - start) & SCHED_CYCLES_MASK;
+}
+
+void sched_run() {
+    while (1) {
+        uint32_t start = sched_cycles();
+        uint16_t now = sched_ticks();
+
+        struct sched_task *next = NULL;
+        int16_t next_slack = 0;
+        int16_t wait = INT16_MAX;
+
+        for (uint8_t i = 0; i < sched_task_count; i++) {
+            struct sched_task *task = &sched_tasks[i];
+
+            int16_t until_release = task->release - now;
+
+            if (until_release > 0) {
+                if (until_release < wait) {
+                    wait = until_release;
+                }
+                continue;
+            }
+
+            // Earliest deadline first
+            int16_t slack = (uint16_t) (task->release + task->deadline - now);
+
+            if (next == NULL || slack < next_slack) {
+                next = task;
+                next_slack = slack;
+            }
+        }
+
+        if (next != NULL) {
+            sched_run_task(next);
+
+            sched_count_iteration((sched_cycles() - start) & SCHED_CYCLES_MASK);
+        } else {
+            sched_sleep(now + wait);
+        }
+
+        sched_update_window();
+    }
+}
+
+bool sched_window_complete() {
+    bool done = sched_window_done;
+    sched_window_done = false;
+
+    return done;
+}
+
+uint8_t sched_awake_percent() {
+    return sched_awake_percent_value;
+}
+
+void sched_get_loop_stats(struct sched_loop_stats *stats) {
+    *stats = sched_loop_last;
+}
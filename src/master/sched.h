@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Run-to-completion scheduler for the main loop. Time is counted in system ticks
+//   of 64 us (one Timer_A0 overflow, or 1/8 with the slow tick). Every task is released once per period and
+//   should finish within its deadline after the release. Of all released tasks
+//   the one with the earliest deadline runs first. The CPU sleeps in LPM0 while
+//   no task is released.
+
+// Cycle-accurate time stamps wrap after 2^26 SMCLK cycles (~4.2 s)
+#define SCHED_CYCLES_MASK 0x3ffffffUL
+
+// CPU shares are measured over windows of 2^24 cycles (~1 s) in 1/256
+#define SCHED_WINDOW_CYCLES (1UL << 24)
+#define SCHED_SHARE_SHIFT 16
+
+struct sched_loop_stats {
+    // Scheduler iterations that ran a task
+    uint16_t iterations;
+    // Shortest and longest of those iterations in cycles, including the
+    //   scheduling itself (saturating)
+    uint16_t min_cycles;
+    uint16_t max_cycles;
+};
+
+// System ticks per Timer_A0 overflow as power of two: 0 normally, 3 with the slow tick
+extern volatile uint8_t sched_tick_shift;
+
+struct sched_task {
+    void (*run)();
+    // In ticks
+    uint16_t period;
+    uint16_t deadline;
+
+    // Tick of the next release
+    uint16_t release;
+
+    // Runs that finished after their deadline and releases that were skipped
+    //   because the previous one hadn't run yet (saturating)
+    uint16_t overruns;
+    // Longest run in cycles (saturating)
+    uint16_t max_cycles;
+
+    // Cycles used in the current window
+    uint32_t window_cycles;
+    // Share of the last window, in 1/256
+    uint8_t share;
+};
+
+void sched_init(struct sched_task *tasks, uint8_t task_count);
+// Run Timer_A0 at 1/8 of its rate, only while nothing else uses it. Interrupts must be disabled
+void sched_set_slow_tick(bool slow);
+// Called on every Timer_A0 overflow, returns true if the CPU has to wake up
+bool sched_tick();
+// Current time in ticks
+uint16_t sched_ticks();
+// Current time in SMCLK cycles, masked with SCHED_CYCLES_MASK
+uint32_t sched_cycles();
+// Runs the tasks forever
+void sched_run() __attribute__((noreturn));
+// Returns true once after each completed statistics window
+bool sched_window_complete();
+// Percentage of the last window the CPU was awake
+uint8_t sched_awake_percent();
+// Loop statistics of the last window
+void sched_get_loop_stats(struct sched_loop_stats *stats);
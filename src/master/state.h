@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <shared/commands.h>
+
+enum mode {
+    MODE_STATIC,
+    MODE_ANIMATED,
+    MODE_WAVE,
+    MODE_VISUALIZER,
+    // Colours come from the host link
+    MODE_STREAM
+};
+
+// Several changes that are applied together, with a single update of the outputs.
+//   'fields' is a mask of APPLY_STATE_* bits, the other members are only used if
+//   their bit is set
+struct state {
+    uint8_t fields;
+    uint8_t brightness;
+    uint8_t speed;
+    // With APPLY_STATE_LOOK: the mode, the animation or wave effect index and the static colour
+    uint8_t mode;
+    uint8_t index;
+    uint32_t color;
+};
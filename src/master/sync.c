@@ -0,0 +1,197 @@
+#include "sync.h"
+
+#include <msp430.h>
+
+#include "rgb.h"
+#include "sched.h"
+
+#if defined(SYNC_ROLE_LEADER) && defined(SYNC_ROLE_FOLLOWER)
+#error "A master can't be sync leader and follower at the same time"
+#endif
+
+#if (defined(SYNC_ROLE_LEADER) || defined(SYNC_ROLE_FOLLOWER)) && defined(RGB_BACKEND_BAM) && RGB_ZONE_COUNT > 3
+#error "The sync line is used by the fourth BAM zone"
+#endif
+
+// One step is 2^24, a whole sync period wraps the accumulator
+#define SYNC_INCREMENT_NOMINAL ((1UL << 24) / SYNC_TICKS_PER_STEP)
+// Followers may run up to ~3% faster or slower than nominal
+#define SYNC_ADJUSTMENT_MAX ((int32_t) (SYNC_INCREMENT_NOMINAL >> 5))
+
+// Errors above 16 steps (~130 ms) aren't corrected gradually, the phase is set directly
+#define SYNC_LOCK_RANGE (1L << 28)
+// Statistics are collected once the error has dropped below 8 ms
+#define SYNC_SETTLED_RANGE (1L << 24)
+
+// Phase units per SMCLK cycle and per microsecond (16 MHz)
+#define SYNC_CYCLE_SHIFT 7
+#define SYNC_US_SHIFT 11
+
+static volatile uint32_t sync_phase = 0;
+static volatile uint32_t sync_increment = SYNC_INCREMENT_NOMINAL;
+
+#ifdef SYNC_ROLE_FOLLOWER
+static int32_t sync_integral = 0;
+static bool sync_settled = false;
+
+static volatile struct sync_stats sync_stats;
+static volatile bool sync_stats_updated = false;
+#endif
+
+void sync_init() {
+    sync_phase = 0;
+    sync_increment = SYNC_INCREMENT_NOMINAL;
+
+#if defined(SYNC_ROLE_LEADER)
+    P1DIR |= SYNC_PIN;
+    P1OUT &= ~SYNC_PIN;
+    P1SEL &= ~SYNC_PIN;
+#elif defined(SYNC_ROLE_FOLLOWER)
+    // Input with pull-down so that a missing leader doesn't cause pulses,
+    //   triggers on the rising edge
+    P1DIR &= ~SYNC_PIN;
+    P1SEL &= ~SYNC_PIN;
+    P1OUT &= ~SYNC_PIN;
+    P1REN |= SYNC_PIN;
+    P1IES &= ~SYNC_PIN;
+    P1IFG &= ~SYNC_PIN;
+    P1IE |= SYNC_PIN;
+#endif
+}
+
+uint8_t sync_tick(uint8_t shift) {
+    uint32_t previous = sync_phase;
+    uint32_t phase = previous + (sync_increment << shift);
+
+    sync_phase = phase;
+
+#ifdef SYNC_ROLE_LEADER
+    // The pulse lasts one tick (64 us) from the start of every period
+    if (phase < previous) {
+        P1OUT |= SYNC_PIN;
+    } else {
+        P1OUT &= ~SYNC_PIN;
+    }
+#endif
+
+    return (uint8_t) ((phase >> 24) - (previous >> 24));
+}
+
+bool sync_take_stats(struct sync_stats *stats) {
+#ifdef SYNC_ROLE_FOLLOWER
+    __disable_interrupt();
+
+    bool updated = sync_stats_updated;
+    sync_stats_updated = false;
+
+    stats->error_last = sync_stats.error_last;
+    stats->error_min = sync_stats.error_min;
+    stats->error_max = sync_stats.error_max;
+    stats->adjustment = sync_stats.adjustment;
+    stats->pulses = sync_stats.pulses;
+    stats->jumps = sync_stats.jumps;
+
+    __enable_interrupt();
+
+    return updated;
+#else
+    (void) stats;
+
+    return false;
+#endif
+}
+
+#ifdef SYNC_ROLE_FOLLOWER
+
+static int16_t error_to_us(int32_t error) {
+    error >>= SYNC_US_SHIFT;
+
+    if (error < INT16_MIN) {
+        return INT16_MIN;
+    } else if (error > INT16_MAX) {
+        return INT16_MAX;
+    }
+
+    return error;
+}
+
+static int32_t clamp_adjustment(int32_t value, int32_t limit) {
+    if (value < -limit) {
+        return -limit;
+    } else if (value > limit) {
+        return limit;
+    }
+
+    return value;
+}
+
+static void sync_pulse() {
+    uint32_t phase = sync_phase;
+
+    uint8_t shift = sched_tick_shift;
+    uint16_t count = TA0R;
+
+    // An overflow that the tick interrupt hasn't handled yet. If the count is
+    //   high, it overflowed after being read (same as sched_cycles())
+    if ((TA0CTL & TAIFG) && count < RGB_PWM_PERIOD / 2) {
+        phase += sync_increment << shift;
+    }
+
+    // The leader pulses at phase 0, so the wrapped phase is the error.
+    //   The timer count adds the position within the current tick
+    int32_t error = (int32_t) (phase + ((uint32_t) count << (SYNC_CYCLE_SHIFT + shift)));
+
+    sync_stats.pulses++;
+
+    if (error < -SYNC_LOCK_RANGE || error > SYNC_LOCK_RANGE) {
+        // The frequency estimate is kept, only the phase was off
+        sync_phase -= error;
+
+        sync_settled = false;
+        sync_stats.jumps++;
+
+        return;
+    }
+
+    // PI loop, per sync period the proportional part corrects 1/2 and the
+    //   integral part 1/8 of the error: one increment unit shifts the phase by 2^15
+    //   per period. The integral is kept with 10 more fractional bits
+    sync_integral = clamp_adjustment(sync_integral + (error >> 8), SYNC_ADJUSTMENT_MAX << 10);
+
+    int32_t adjustment = clamp_adjustment((error >> 16) + (sync_integral >> 10), SYNC_ADJUSTMENT_MAX);
+
+    sync_increment = SYNC_INCREMENT_NOMINAL - adjustment;
+
+    int16_t error_us = error_to_us(error);
+
+    if (!sync_settled && error > -SYNC_SETTLED_RANGE && error < SYNC_SETTLED_RANGE) {
+        sync_settled = true;
+
+        sync_stats.error_min = error_us;
+        sync_stats.error_max = error_us;
+    }
+
+    if (sync_settled) {
+        if (error_us < sync_stats.error_min) {
+            sync_stats.error_min = error_us;
+        }
+        if (error_us > sync_stats.error_max) {
+            sync_stats.error_max = error_us;
+        }
+    }
+
+    sync_stats.error_last = error_us;
+    sync_stats.adjustment = adjustment;
+    sync_stats_updated = true;
+}
+
+__attribute__((interrupt(PORT1_VECTOR)))
+void PORT1_ISR() {
+    if (P1IFG & SYNC_PIN) {
+        P1IFG &= ~SYNC_PIN;
+
+        sync_pulse();
+    }
+}
+
+#endif
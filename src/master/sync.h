@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Animation clock shared by several masters over a dedicated sync line.
+//   The animation steps come from a 32-bit phase accumulator that is advanced on
+//   every Timer_A0 overflow. Its upper 8 bits count the steps of a sync period.
+//   The leader pulses the line whenever a period starts. Followers measure their
+//   phase at the pulse and adjust their increment with a PI loop.
+
+// Sync line between all masters (P1.3), output on the leader, input on followers
+#define SYNC_PIN BIT3
+
+// Animation steps per sync period (~2.1 s)
+#define SYNC_PERIOD_STEPS 256
+
+// Timer_A0 overflows per animation step
+#define SYNC_TICKS_PER_STEP 128
+
+struct sync_stats {
+    // Phase error at the last pulse and its extremes since the loop settled, in us.
+    //   Positive if the follower is ahead of the leader
+    int16_t error_last;
+    int16_t error_min;
+    int16_t error_max;
+    // Deviation of the follower's clock from its nominal rate, in 1/131072
+    int16_t adjustment;
+    uint16_t pulses;
+    // Times the phase was set directly because the error was too large (first pulse, lost lock)
+    uint16_t jumps;
+};
+
+void sync_init();
+// Called on every Timer_A0 overflow with sched_tick_shift, returns the number of elapsed animation steps
+uint8_t sync_tick(uint8_t shift);
+// Copies the statistics, returns false if there was no pulse since the last call
+bool sync_take_stats(struct sync_stats *stats);
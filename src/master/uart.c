@@ -3,6 +3,14 @@
 
 #include <msp430.h>
 
+#include <shared/ring.h>
+
+#ifdef LOGGING
+
+// Bytes are only queued here and sent by uart_flush(), so logging never blocks.
+//   A few log lines, more is dropped anyway at 9600 baud
+RING_DEFINE(uart_tx_ring, 64);
+
 void uart_init() {
     // Initialize UART pins
     P1SEL |= UART_RXD | UART_TXD;
@@ -25,8 +33,17 @@ void uart_init() {
 }
 
 void uart_send(uint8_t data) {
-    while (!(IFG2 & UCA0TXIFG));
-    UCA0TXBUF = data;
+    // Dropped if the ring is full
+    ring_push(&uart_tx_ring, data);
+}
+
+void uart_flush() {
+    uint8_t data;
+
+    // Only as much as the transmitter takes without waiting
+    while ((IFG2 & UCA0TXIFG) && ring_pop(&uart_tx_ring, &data)) {
+        UCA0TXBUF = data;
+    }
 }
 
 void uart_puts(char *s) {
@@ -47,3 +64,5 @@ void uart_puthex(uint16_t n) {
     uart_send(hex[(n >> 4) & 0xf]);
     uart_send(hex[n & 0xf]);
 }
+
+#endif
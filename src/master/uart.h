@@ -6,7 +6,15 @@
 #define UART_RXD BIT1
 #define UART_TXD BIT2
 
+// The debug log. The WS2812 back end and the host link need USCI_A0 for
+//   themselves, uart.c is empty then and doesn't take any RAM
+#if !defined(NDEBUG) && !defined(RGB_BACKEND_WS2812) && !defined(HOST_LINK)
+#define LOGGING
+#endif
+
 void uart_init();
+// Queues the byte, uart_flush() has to be called regularly to send it
 void uart_send(uint8_t data);
+void uart_flush();
 void uart_puts(char *s);
 void uart_puthex(uint16_t n);
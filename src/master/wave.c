@@ -0,0 +1,35 @@
+#include "wave.h"
+
+static const uint16_t WAVE_SIN_LUT[] = {
+#include "WAVE_SIN_LUT.txt"
+};
+
+static const uint16_t WAVE_TRI_LUT[] = {
+#include "WAVE_TRI_LUT.txt"
+};
+
+static const uint16_t WAVE_SAW_LUT[] = {
+#include "WAVE_SAW_LUT.txt"
+};
+
+void wave_init(struct wave_channel *channel, enum wave_shape shape, uint16_t phase_offset) {
+    switch (shape) {
+        case WAVE_TRIANGLE: channel->table = WAVE_TRI_LUT; break;
+        case WAVE_SAW: channel->table = WAVE_SAW_LUT; break;
+        default: channel->table = WAVE_SIN_LUT; break;
+    }
+
+    // The offset is applied once here, so stepping stays a single add
+    channel->phase = phase_offset;
+    channel->frequency = 0;
+}
+
+void wave_set_frequency(struct wave_channel *channel, uint16_t frequency) {
+    channel->frequency = frequency;
+}
+
+uint16_t wave_step(struct wave_channel *channel) {
+    channel->phase += channel->frequency;
+
+    return channel->table[channel->phase >> 8];
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+// Direct digital synthesis: every channel has a 16-bit phase accumulator whose
+//   upper 8 bits index a 256-entry wavetable with values from 0 to 1023
+
+enum wave_shape {
+    WAVE_SINE,
+    WAVE_TRIANGLE,
+    WAVE_SAW
+};
+
+struct wave_channel {
+    const uint16_t *table;
+    uint16_t phase;
+    // Phase increment per step, 65536 is one period
+    uint16_t frequency;
+};
+
+void wave_init(struct wave_channel *channel, enum wave_shape shape, uint16_t phase_offset);
+void wave_set_frequency(struct wave_channel *channel, uint16_t frequency);
+// Advance by one step and return the new value (0-1023)
+uint16_t wave_step(struct wave_channel *channel);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "wave.h"
+
+#define WAVE_CHANNEL_COUNT 3
+
+// Phase increment per animation step at speed 0 (~33 s per period);
+//   it scales linearly with the speed
+#define WAVE_BASE_FREQUENCY 16
+
+struct wave_effect {
+    enum wave_shape shape;
+    // Per channel (r, g, b)
+    uint16_t phase_offsets[WAVE_CHANNEL_COUNT];
+    // Per channel frequency multiplier in quarters
+    uint8_t frequency_ratios[WAVE_CHANNEL_COUNT];
+};
+
+static const struct wave_effect wave_effects[] = {
+    // Breathing
+    { WAVE_SINE, { 0, 0, 0 }, { 4, 4, 4 } },
+    // Rainbow: sines 120 degrees apart
+    { WAVE_SINE, { 0, 21845, 43691 }, { 4, 4, 4 } },
+    // Colour wheel: triangles 120 degrees apart
+    { WAVE_TRIANGLE, { 0, 21845, 43691 }, { 4, 4, 4 } },
+    // Drift: saws at slightly different rates
+    { WAVE_SAW, { 0, 0, 0 }, { 4, 5, 6 } }
+};
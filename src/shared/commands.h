@@ -6,6 +6,9 @@
 none
 00000000
 
+toggle on/off
+00000001
+
 on/off
 00000010
 00000011
@@ -30,19 +33,23 @@ brightness
 speed
 11xxxxxx
 
-unused
-00000001
+brightness delta (signed)
+010xxxxx
+
+speed delta (signed)
+011xxxxx
+
+extended command, followed by xxx (1-7) payload bytes
 00001xxx
-01xxxxxx
 
 */
 
 // TODO: broadcast state changes from master?
 
-// TODO: inter-slave communication, e.g. enable visualizer from remote
-
 #define SLAVE_COMMAND_NONE 0x00
 
+#define SLAVE_COMMAND_TOGGLE 0x01
+
 #define SLAVE_COMMAND_OFF 0x02
 #define SLAVE_COMMAND_ON 0x03
 
@@ -58,5 +65,108 @@ unused
 #define SLAVE_COMMAND_BRIGHTNESS_SET(brightness) (0x80 | ((brightness) & 0x3f))
 #define SLAVE_COMMAND_SPEED_SET(speed) (0xc0 | ((speed) & 0x3f))
 
+// The master fetches the payload with a second read from the same slave.
+//   The first payload byte is one of the EXTENDED_COMMAND_* ids
+#define SLAVE_COMMAND_EXTENDED(length) (0x08 | ((length) & 0x07))
+#define SLAVE_COMMAND_EXTENDED_MAX_LENGTH 7
+
+// Several increments/decrements combined into one command
+#define SLAVE_COMMAND_DELTA_MIN (-16)
+#define SLAVE_COMMAND_DELTA_MAX 15
+#define SLAVE_COMMAND_BRIGHTNESS_DELTA(delta) (0x40 | ((delta) & 0x1f))
+#define SLAVE_COMMAND_SPEED_DELTA(delta) (0x60 | ((delta) & 0x1f))
+// Sign-extend the delta of a SLAVE_COMMAND_*_DELTA command
+#define SLAVE_COMMAND_DELTA_VALUE(command) ((int8_t) ((command) << 3) >> 3)
+
+#define SLAVE_ANIMATION_VISUALIZER 4
+// Waveform effects: breathing, rainbow, colour wheel, drift
+#define SLAVE_ANIMATION_WAVE_FIRST 5
+#define SLAVE_ANIMATION_COUNT 9
+
+// Payload: id, flags, r, g, b (8 bits each)
+#define EXTENDED_COMMAND_VISUALIZER_FRAME 0x01
+#define VISUALIZER_FLAG_BEAT 0x01
+
+// Select any of the master's keyframe animations, SLAVE_COMMAND_ANIMATION(0-3) only reaches the first four
+// Payload: id, animation index
+#define EXTENDED_COMMAND_ANIMATION_SCRIPT 0x02
+
+// Select a colour from the master's palette, SLAVE_COMMAND_COLOR only reaches the 16 basic colours
+// Payload: id, index (16 bits, big endian)
+#define EXTENDED_COMMAND_COLOR_PALETTE 0x03
+
+// Payload: id, hue (0-1535, 16 bits, big endian), saturation, value
+#define EXTENDED_COMMAND_COLOR_HSV 0x04
+
+// Select the output zones (bit mask) that following colour changes and animations apply to,
+//   the other zones keep their current colour. Only masters with several zones use this
+// Payload: id, zone mask
+#define EXTENDED_COMMAND_ZONES 0x05
+
+// Sent by sleeping slaves about once per second: the share of time they were awake
+// Payload: id, slave address, percentage (0-100)
+#define EXTENDED_COMMAND_SLAVE_DUTY 0x06
+
+// Recall a scene stored on the master: mode, colour or effect, brightness and speed at once.
+//   Also turns the lights on
+// Payload: id, scene index (0-7)
+#define EXTENDED_COMMAND_SCENE_RECALL 0x07
+
+// Store the current look in one of the master's scenes
+// Payload: id, scene index (0-7)
+#define EXTENDED_COMMAND_SCENE_SAVE 0x08
+
+// Change several things at once, the outputs are updated only once.
+//   Fields that aren't in the mask are ignored
+// Payload: id, APPLY_STATE_* field mask, brightness, speed, APPLY_STATE_LOOK_* look,
+//   value (palette index, animation or wave effect index, 16 bits, big endian)
+#define EXTENDED_COMMAND_APPLY_STATE 0x09
+#define APPLY_STATE_ON 0x01
+#define APPLY_STATE_OFF 0x02
+#define APPLY_STATE_BRIGHTNESS 0x04
+#define APPLY_STATE_SPEED 0x08
+#define APPLY_STATE_LOOK 0x10
+#define APPLY_STATE_LOOK_PALETTE 0x00
+#define APPLY_STATE_LOOK_ANIMATION 0x01
+#define APPLY_STATE_LOOK_WAVE 0x02
+#define APPLY_STATE_LOOK_VISUALIZER 0x03
+
+// Ask the master for one of its health counters. It answers with a write to the
+//   requesting slave: MASTER_COMMAND_STATS, register, value (16 bits, big endian)
+// Payload: id, STATS_REGISTER_* register
+#define EXTENDED_COMMAND_STATS_REQUEST 0x0a
+// Counters saturate at 0xffff, the loop registers cover the last ~1 s window
+#define STATS_REGISTER_POLLS 0x00
+// Polls that returned a command
+#define STATS_REGISTER_POLLS_WITH_DATA 0x01
+// Polls the slave didn't acknowledge
+#define STATS_REGISTER_NACKS 0x02
+// Animation steps that were handled late, together with the next one
+#define STATS_REGISTER_SKIPPED_STEPS 0x03
+// Main loop iterations that ran a task
+#define STATS_REGISTER_LOOP_RATE 0x04
+// Shortest and longest of those iterations in cycles (16 MHz)
+#define STATS_REGISTER_LOOP_MIN 0x05
+#define STATS_REGISTER_LOOP_MAX 0x06
+// Percentage of the time the CPU was awake
+#define STATS_REGISTER_AWAKE 0x07
+#define STATS_REGISTER_COUNT 8
+
+// Set a single pixel of the master's strip and stop the current animation.
+//   Only masters with the WS2812 back end use this
+// Payload: id, pixel (16 bits, big endian), r, g, b (8 bits each), brightness (0-63)
+#define EXTENDED_COMMAND_PIXEL 0x0b
+
+// Levels of the visualizer's frequency bands, bass first. Sent halfway between two
+//   EXTENDED_COMMAND_VISUALIZER_FRAMEs, which only carry a colour mixed from them.
+//   Masters with the WS2812 back end show the bands as bars and only take the beat
+//   flag from the frames, the others ignore the bands
+// Payload: id, VISUALIZER_BAND_COUNT levels (0-255 each)
+#define EXTENDED_COMMAND_VISUALIZER_BANDS 0x0c
+#define VISUALIZER_BAND_COUNT 6
+
 #define MASTER_COMMAND_ANIMATION_OFF 0x01
 #define MASTER_COMMAND_ANIMATION_ON 0x02
+#define MASTER_COMMAND_VISUALIZER_ON 0x03
+// Only sent to a single slave, followed by register and value (see EXTENDED_COMMAND_STATS_REQUEST)
+#define MASTER_COMMAND_STATS 0x04
@@ -0,0 +1,51 @@
+#include "flash.h"
+
+#include <msp430.h>
+
+void flash_init(uint8_t divider) {
+    // MCLK, divided by 'divider'
+    FCTL2 = FWKEY | FSSEL_1 | (divider - 1);
+}
+
+void flash_erase(const void *segment) {
+    // The CPU is halted while the flash controller is busy anyway,
+    //   but interrupts must not access the flash before we re-lock it
+    __istate_t s = __get_interrupt_state();
+    __disable_interrupt();
+
+    // Unlock
+    FCTL3 = FWKEY;
+    // Segment erase
+    FCTL1 = FWKEY | ERASE;
+    // Dummy write starts the erase cycle
+    *(volatile uint8_t *) segment = 0;
+
+    // Lock again
+    FCTL1 = FWKEY;
+    FCTL3 = FWKEY | LOCK;
+
+    __set_interrupt_state(s);
+}
+
+void flash_write(const void *dest, const void *src, uint16_t length) {
+    volatile uint8_t *d = (volatile uint8_t *) dest;
+    const uint8_t *s8 = (const uint8_t *) src;
+
+    __istate_t s = __get_interrupt_state();
+    __disable_interrupt();
+
+    // Unlock
+    FCTL3 = FWKEY;
+    // Byte/word write
+    FCTL1 = FWKEY | WRT;
+
+    for (uint16_t i = 0; i < length; i++) {
+        d[i] = s8[i];
+    }
+
+    // Lock again
+    FCTL1 = FWKEY;
+    FCTL3 = FWKEY | LOCK;
+
+    __set_interrupt_state(s);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+#define FLASH_SEGMENT_SIZE 512
+#define FLASH_INFO_SEGMENT_SIZE 64
+
+// The flash timing generator needs a clock between 257 kHz and 476 kHz,
+//   so divider has to be chosen according to MCLK (e.g. 20 @ 8 MHz, 40 @ 16 MHz)
+void flash_init(uint8_t divider);
+void flash_erase(const void *segment);
+void flash_write(const void *dest, const void *src, uint16_t length);
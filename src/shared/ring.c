@@ -0,0 +1,80 @@
+#include "ring.h"
+
+#include <stddef.h>
+
+uint8_t ring_count(const struct ring *ring) {
+    return ring->head - ring->tail;
+}
+
+bool ring_push(struct ring *ring, uint8_t value) {
+    uint8_t head = ring->head;
+    uint8_t count = head - ring->tail;
+
+    if (count > ring->mask) {
+        if (ring->overflows < 0xffff) {
+            ring->overflows++;
+        }
+
+        return false;
+    }
+
+    ring->data[head & ring->mask] = value;
+    // Publish the byte only after it has been written
+    ring->head = head + 1;
+
+    count++;
+    if (count > ring->peak) {
+        ring->peak = count;
+    }
+
+    return true;
+}
+
+bool ring_push_block(struct ring *ring, const uint8_t *data, uint8_t length) {
+    uint8_t head = ring->head;
+    uint8_t count = head - ring->tail;
+
+    if ((uint16_t) count + length > (uint16_t) ring->mask + 1) {
+        if (ring->overflows < 0xffff) {
+            ring->overflows++;
+        }
+
+        return false;
+    }
+
+    for (uint8_t i = 0; i < length; i++) {
+        ring->data[(uint8_t) (head + i) & ring->mask] = data[i];
+    }
+    ring->head = head + length;
+
+    count += length;
+    if (count > ring->peak) {
+        ring->peak = count;
+    }
+
+    return true;
+}
+
+bool ring_pop(struct ring *ring, uint8_t *value) {
+    uint8_t tail = ring->tail;
+
+    if (tail == ring->head) {
+        return false;
+    }
+
+    *value = ring->data[tail & ring->mask];
+    // Release the slot only after it has been read
+    ring->tail = tail + 1;
+
+    return true;
+}
+
+volatile uint8_t *ring_back(struct ring *ring) {
+    uint8_t head = ring->head;
+
+    if (head == ring->tail) {
+        return NULL;
+    }
+
+    return &ring->data[(uint8_t) (head - 1) & ring->mask];
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Single-producer/single-consumer byte queue that doesn't need interrupt masking.
+//   The producer only ever writes 'head' and the consumer only ever writes 'tail'.
+//   Both are free-running 8-bit counters, so 'head - tail' is the fill level
+//   and all slots can be used.
+struct ring {
+    volatile uint8_t *data;
+    uint8_t mask;
+    volatile uint8_t head;
+    volatile uint8_t tail;
+
+    // Statistics, written by the producer
+    // Highest fill level seen
+    volatile uint8_t peak;
+    // Number of bytes dropped because the ring was full (saturating)
+    volatile uint16_t overflows;
+};
+
+// Define a ring with 'size' bytes of storage (a power of two, at most 128)
+#define RING_DEFINE(name, size) \
+    _Static_assert((size) >= 2 && (size) <= 128 && ((size) & ((size) - 1)) == 0, "Invalid ring size"); \
+    static volatile uint8_t name##_data[size]; \
+    static struct ring name = { name##_data, (size) - 1, 0, 0, 0, 0 }
+
+uint8_t ring_count(const struct ring *ring);
+// Producer side, returns false if the ring is full
+bool ring_push(struct ring *ring, uint8_t value);
+// Push all bytes or none, the consumer sees them at once
+bool ring_push_block(struct ring *ring, const uint8_t *data, uint8_t length);
+// Consumer side, returns false if the ring is empty
+bool ring_pop(struct ring *ring, uint8_t *value);
+// The newest byte that hasn't been consumed yet, or NULL if the ring is empty.
+//   Only safe to modify while the consumer can't run
+volatile uint8_t *ring_back(struct ring *ring);
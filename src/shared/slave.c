@@ -0,0 +1,270 @@
+#include "slave.h"
+
+#include <msp430.h>
+#include <stddef.h>
+
+#include "commands.h"
+#include "i2c.h"
+#include "ring.h"
+
+RING_DEFINE(slave_queue, SLAVE_QUEUE_SIZE);
+
+volatile bool slave_master_mode_animated = false;
+
+static void (*slave_master_command_handler)(uint8_t command) = NULL;
+
+// The newest bytes in the queue are an extended command payload, which must not be coalesced
+static bool slave_queue_back_extended = false;
+
+// Answer to a stats request: MASTER_COMMAND_STATS, register, value
+static uint8_t slave_stats_reply[4];
+static uint8_t slave_stats_fill = 0;
+static volatile bool slave_stats_received = false;
+
+// Value ranges the master clamps brightness and speed to
+#define BRIGHTNESS_MIN 1
+#define BRIGHTNESS_MAX 63
+#define SPEED_MIN 0
+#define SPEED_MAX 63
+
+enum command_parameter {
+    PARAMETER_NONE,
+    PARAMETER_BRIGHTNESS,
+    PARAMETER_SPEED
+};
+
+static enum command_parameter command_parameter(uint8_t command) {
+    switch (command) {
+        case SLAVE_COMMAND_BRIGHTNESS_DECREMENT:
+        case SLAVE_COMMAND_BRIGHTNESS_INCREMENT:
+            return PARAMETER_BRIGHTNESS;
+        case SLAVE_COMMAND_SPEED_DECREMENT:
+        case SLAVE_COMMAND_SPEED_INCREMENT:
+            return PARAMETER_SPEED;
+        default:
+            switch (command & 0xe0) {
+                case 0x40: return PARAMETER_BRIGHTNESS;
+                case 0x60: return PARAMETER_SPEED;
+                case 0x80: case 0xa0: return PARAMETER_BRIGHTNESS;
+                case 0xc0: case 0xe0: return PARAMETER_SPEED;
+                default: return PARAMETER_NONE;
+            }
+    }
+}
+
+static bool command_is_absolute(uint8_t command) {
+    return command & 0x80;
+}
+
+static int8_t command_delta(uint8_t command) {
+    switch (command) {
+        case SLAVE_COMMAND_BRIGHTNESS_DECREMENT:
+        case SLAVE_COMMAND_SPEED_DECREMENT:
+            return -1;
+        case SLAVE_COMMAND_BRIGHTNESS_INCREMENT:
+        case SLAVE_COMMAND_SPEED_INCREMENT:
+            return 1;
+        default:
+            return SLAVE_COMMAND_DELTA_VALUE(command);
+    }
+}
+
+// Combine two consecutive commands into one, if possible.
+//   Returns SLAVE_COMMAND_NONE if they have to be sent separately
+static uint8_t coalesce_commands(uint8_t older, uint8_t newer) {
+    enum command_parameter parameter = command_parameter(newer);
+
+    if (parameter == PARAMETER_NONE || parameter != command_parameter(older)) {
+        return SLAVE_COMMAND_NONE;
+    }
+
+    // A newer absolute value supersedes whatever was pending
+    if (command_is_absolute(newer)) {
+        return newer;
+    }
+
+    int8_t delta = command_delta(newer);
+
+    if (command_is_absolute(older)) {
+        // Apply the delta to the pending absolute value like the master would
+        int8_t value = (older & 0x3f) + delta;
+
+        if (parameter == PARAMETER_BRIGHTNESS) {
+            if (value < BRIGHTNESS_MIN) value = BRIGHTNESS_MIN;
+            if (value > BRIGHTNESS_MAX) value = BRIGHTNESS_MAX;
+
+            return SLAVE_COMMAND_BRIGHTNESS_SET(value);
+        } else {
+            if (value < SPEED_MIN) value = SPEED_MIN;
+            if (value > SPEED_MAX) value = SPEED_MAX;
+
+            return SLAVE_COMMAND_SPEED_SET(value);
+        }
+    }
+
+    int8_t sum = command_delta(older) + delta;
+
+    if (sum < SLAVE_COMMAND_DELTA_MIN || sum > SLAVE_COMMAND_DELTA_MAX) {
+        return SLAVE_COMMAND_NONE;
+    }
+
+    return (parameter == PARAMETER_BRIGHTNESS) ? SLAVE_COMMAND_BRIGHTNESS_DELTA(sum) : SLAVE_COMMAND_SPEED_DELTA(sum);
+}
+
+void slave_init(uint8_t address, void (*master_command_handler)(uint8_t command)) {
+    slave_master_command_handler = master_command_handler;
+
+    // Listen to broadcasts as well
+    i2c_init_slave(address, true);
+
+    IE2 |= UCB0RXIE | UCB0TXIE;
+    // The end of each write resets the stats answer
+    UCB0I2CIE |= UCSTPIE;
+}
+
+void slave_enqueue(uint8_t command) {
+    // The queue itself needs no locking, but the newest command may only be
+    //   rewritten while the master can't fetch it
+    __istate_t s = __get_interrupt_state();
+    __disable_interrupt();
+
+    volatile uint8_t *last = ring_back(&slave_queue);
+    if (last != NULL && !slave_queue_back_extended) {
+        uint8_t coalesced = coalesce_commands(*last, command);
+
+        if (coalesced != SLAVE_COMMAND_NONE) {
+            *last = coalesced;
+
+            __set_interrupt_state(s);
+            return;
+        }
+    }
+
+    __set_interrupt_state(s);
+
+    if (ring_push(&slave_queue, command)) {
+        slave_queue_back_extended = false;
+    }
+}
+
+bool slave_enqueue_extended(const uint8_t *payload, uint8_t length) {
+    uint8_t buffer[1 + SLAVE_COMMAND_EXTENDED_MAX_LENGTH];
+
+    if (length == 0 || length > SLAVE_COMMAND_EXTENDED_MAX_LENGTH) {
+        return false;
+    }
+
+    buffer[0] = SLAVE_COMMAND_EXTENDED(length);
+    for (uint8_t i = 0; i < length; i++) {
+        buffer[1 + i] = payload[i];
+    }
+
+    if (!ring_push_block(&slave_queue, buffer, 1 + length)) {
+        return false;
+    }
+
+    slave_queue_back_extended = true;
+
+    return true;
+}
+
+uint8_t slave_queue_count() {
+    return ring_count(&slave_queue);
+}
+
+uint16_t slave_queue_overflows() {
+    return slave_queue.overflows;
+}
+
+uint8_t slave_queue_peak() {
+    return slave_queue.peak;
+}
+
+bool slave_request_stats(uint8_t reg) {
+    uint8_t payload[] = { EXTENDED_COMMAND_STATS_REQUEST, reg };
+
+    return slave_enqueue_extended(payload, sizeof(payload));
+}
+
+bool slave_take_stats(uint8_t *reg, uint16_t *value) {
+    __istate_t s = __get_interrupt_state();
+    __disable_interrupt();
+
+    bool received = slave_stats_received;
+    slave_stats_received = false;
+
+    *reg = slave_stats_reply[1];
+    *value = (uint16_t) slave_stats_reply[2] << 8 | slave_stats_reply[3];
+
+    __set_interrupt_state(s);
+
+    return received;
+}
+
+// Returns true while the bytes of a stats answer are received
+static bool receive_stats_reply(uint8_t data) {
+    // The master answers with a write to our own address, broadcasts are commands
+    if (UCB0STAT & UCGC) {
+        return false;
+    }
+
+    if (slave_stats_fill == 0 && data != MASTER_COMMAND_STATS) {
+        return false;
+    }
+
+    slave_stats_reply[slave_stats_fill] = data;
+    slave_stats_fill++;
+
+    if (slave_stats_fill == sizeof(slave_stats_reply)) {
+        slave_stats_fill = 0;
+        slave_stats_received = true;
+    }
+
+    return true;
+}
+
+__attribute__((interrupt(USCIAB0TX_VECTOR)))
+void USCIAB0TX_ISR() {
+    if (IFG2 & UCB0RXIFG) {
+        uint8_t master_command = UCB0RXBUF;
+
+        if (!receive_stats_reply(master_command)) {
+            switch (master_command) {
+                case MASTER_COMMAND_ANIMATION_OFF:
+                    slave_master_mode_animated = false;
+                    break;
+                case MASTER_COMMAND_ANIMATION_ON:
+                    slave_master_mode_animated = true;
+                    break;
+            }
+
+            if (slave_master_command_handler != NULL) {
+                slave_master_command_handler(master_command);
+            }
+        }
+    }
+
+    if (IFG2 & UCB0TXIFG) {
+        uint8_t command;
+
+        if (!ring_pop(&slave_queue, &command)) {
+            command = SLAVE_COMMAND_NONE;
+        }
+
+        UCB0TXBUF = command;
+    }
+
+    // Slaves that sleep in their main loop may be waiting for the queue to drain
+    __bic_SR_register_on_exit(LPM0_bits);
+}
+
+// Only the STOP condition is enabled of the I2C state interrupts
+__attribute__((interrupt(USCIAB0RX_VECTOR)))
+void USCIAB0RX_ISR() {
+    if (UCB0STAT & UCSTPIFG) {
+        UCB0STAT &= ~UCSTPIFG;
+
+        // A cut-off answer must not continue in the next write
+        slave_stats_fill = 0;
+    }
+}
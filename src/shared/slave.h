@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Common slave firmware: the command queue the master polls, the I2C
+//   interrupts that serve it (data on USCIAB0TX, STOP on USCIAB0RX) and
+//   handling of the master's broadcasts
+
+// Set for the whole library by the build (SLAVE_QUEUE_SIZE in shared/CMakeLists.txt)
+#ifndef SLAVE_QUEUE_SIZE
+#error "SLAVE_QUEUE_SIZE isn't defined"
+#endif
+
+// Mirrored from the master's MASTER_COMMAND_ANIMATION_* broadcasts
+extern volatile bool slave_master_mode_animated;
+
+// 'master_command_handler' is called from the interrupt for every broadcast, may be NULL
+void slave_init(uint8_t address, void (*master_command_handler)(uint8_t command));
+// Queue a command for the master, merging it into the previous one if the master hasn't fetched that yet
+void slave_enqueue(uint8_t command);
+// Queue an extended command (payload[0] is its EXTENDED_COMMAND_* id), returns false if it doesn't fit
+bool slave_enqueue_extended(const uint8_t *payload, uint8_t length);
+uint8_t slave_queue_count();
+uint16_t slave_queue_overflows();
+// Highest number of queued bytes since startup
+uint8_t slave_queue_peak();
+// Ask the master for a STATS_REGISTER_* counter, returns false if the queue is full
+bool slave_request_stats(uint8_t reg);
+// Returns true once for every answer of the master
+bool slave_take_stats(uint8_t *reg, uint16_t *value);
@@ -0,0 +1,241 @@
+#include "keymap.h"
+
+#include <stdbool.h>
+
+#include <shared/flash.h>
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof(*(array)))
+
+// Standard NEC: address 0x10, followed by its inverse
+#define NEC_ADDRESS 0x10ef
+
+// The keymap is an open addressing hash table that fills two flash segments.
+//   There are two of these banks: new keys are programmed into empty slots of the
+//   active bank, which needs no erase. Only when a key is remapped or the probe
+//   limit is exceeded, the valid entries are copied to the other bank and the old
+//   one is erased. This spreads the erase cycles over both segments.
+//   Slot 0 of each bank holds the header.
+// Note that the banks are part of the program image, so flashing the firmware
+//   resets the keymap to the defaults.
+
+#define KEYMAP_MAGIC 0x4b4d
+#define KEYMAP_BANK_SIZE (2 * FLASH_SEGMENT_SIZE)
+#define KEYMAP_SLOT_COUNT (KEYMAP_BANK_SIZE / sizeof(struct keymap_entry))
+// Lookups never look at more slots than this, which keeps them constant time
+#define KEYMAP_MAX_PROBES 8
+
+// An erased slot
+#define KEYMAP_EMPTY_ADDRESS 0xffff
+#define KEYMAP_EMPTY_CODE 0xff
+
+struct keymap_entry {
+    uint16_t address;
+    uint8_t code;
+    uint8_t action;
+};
+
+struct keymap_header {
+    uint16_t magic;
+    uint8_t sequence;
+    uint8_t reserved;
+};
+
+// Volatile because the compiler must not assume the banks keep their initial (zero) contents
+static const volatile struct keymap_entry keymap_banks[2][KEYMAP_SLOT_COUNT]
+    __attribute__((section(".rodata.keymap"), aligned(KEYMAP_BANK_SIZE)));
+
+static const struct keymap_entry keymap_defaults[] = {
+    { NEC_ADDRESS, 0, KEYMAP_ACTION_UP },
+    { NEC_ADDRESS, 1, KEYMAP_ACTION_DOWN },
+    { NEC_ADDRESS, 2, SLAVE_COMMAND_OFF },
+    { NEC_ADDRESS, 3, SLAVE_COMMAND_ON },
+    { NEC_ADDRESS, 4, SLAVE_COMMAND_COLOR(0) },
+    { NEC_ADDRESS, 5, SLAVE_COMMAND_COLOR(5) },
+    { NEC_ADDRESS, 6, SLAVE_COMMAND_COLOR(10) },
+    { NEC_ADDRESS, 7, SLAVE_COMMAND_COLOR(15) },
+    { NEC_ADDRESS, 8, SLAVE_COMMAND_COLOR(1) },
+    { NEC_ADDRESS, 9, SLAVE_COMMAND_COLOR(6) },
+    { NEC_ADDRESS, 10, SLAVE_COMMAND_COLOR(11) },
+    { NEC_ADDRESS, 11, SLAVE_COMMAND_ANIMATION(0) },
+    { NEC_ADDRESS, 12, SLAVE_COMMAND_COLOR(2) },
+    { NEC_ADDRESS, 13, SLAVE_COMMAND_COLOR(7) },
+    { NEC_ADDRESS, 14, SLAVE_COMMAND_COLOR(12) },
+    { NEC_ADDRESS, 15, SLAVE_COMMAND_ANIMATION(1) },
+    { NEC_ADDRESS, 16, SLAVE_COMMAND_COLOR(3) },
+    { NEC_ADDRESS, 17, SLAVE_COMMAND_COLOR(8) },
+    { NEC_ADDRESS, 18, SLAVE_COMMAND_COLOR(13) },
+    { NEC_ADDRESS, 19, SLAVE_COMMAND_ANIMATION(2) },
+    { NEC_ADDRESS, 20, SLAVE_COMMAND_COLOR(4) },
+    { NEC_ADDRESS, 21, SLAVE_COMMAND_COLOR(9) },
+    { NEC_ADDRESS, 22, SLAVE_COMMAND_COLOR(14) },
+    { NEC_ADDRESS, 23, SLAVE_COMMAND_ANIMATION(3) },
+};
+
+static const volatile struct keymap_entry *keymap_active = keymap_banks[0];
+
+static uint8_t keymap_hash(uint16_t address, uint8_t code) {
+    return (code ^ (uint8_t) (address >> 8) ^ (uint8_t) address) & (KEYMAP_SLOT_COUNT - 1);
+}
+
+static uint8_t keymap_next_slot(uint8_t index) {
+    index = (index + 1) & (KEYMAP_SLOT_COUNT - 1);
+
+    // Skip the header
+    if (index == 0) {
+        index = 1;
+    }
+
+    return index;
+}
+
+static bool keymap_entry_empty(const volatile struct keymap_entry *entry) {
+    return entry->address == KEYMAP_EMPTY_ADDRESS && entry->code == KEYMAP_EMPTY_CODE;
+}
+
+static const volatile struct keymap_header *keymap_header(const volatile struct keymap_entry *bank) {
+    return (const volatile struct keymap_header *) &bank[0];
+}
+
+static void keymap_erase(const volatile struct keymap_entry *bank) {
+    flash_erase((const void *) bank);
+    flash_erase((const uint8_t *) bank + FLASH_SEGMENT_SIZE);
+}
+
+// Find the slot holding the key, or the first empty slot on its probe sequence.
+//   Returns 0 if neither is found within KEYMAP_MAX_PROBES slots
+static uint8_t keymap_find_slot(const volatile struct keymap_entry *bank, uint16_t address, uint8_t code) {
+    uint8_t index = keymap_hash(address, code);
+    if (index == 0) {
+        index = 1;
+    }
+
+    for (uint8_t probe = 0; probe < KEYMAP_MAX_PROBES; probe++) {
+        const volatile struct keymap_entry *entry = &bank[index];
+
+        if (keymap_entry_empty(entry) || (entry->address == address && entry->code == code)) {
+            return index;
+        }
+
+        index = keymap_next_slot(index);
+    }
+
+    return 0;
+}
+
+// Returns false if the bank is too crowded for the entry
+static bool keymap_insert(const volatile struct keymap_entry *bank, const struct keymap_entry *entry) {
+    uint8_t index = keymap_find_slot(bank, entry->address, entry->code);
+
+    if (index == 0) {
+        return false;
+    }
+
+    if (keymap_entry_empty(&bank[index])) {
+        flash_write((const void *) &bank[index], entry, sizeof(*entry));
+    }
+
+    return true;
+}
+
+static void keymap_write_header(const volatile struct keymap_entry *bank, uint8_t sequence) {
+    struct keymap_header header = { KEYMAP_MAGIC, sequence, 0xff };
+
+    flash_write((const void *) &bank[0], &header, sizeof(header));
+}
+
+// Copy all entries to the other bank, with 'entry' replacing any previous mapping of its key.
+//   Returns false if an entry doesn't fit into the new bank, the old one stays active then
+static bool keymap_compact(const struct keymap_entry *entry) {
+    const volatile struct keymap_entry *old_bank = keymap_active;
+    const volatile struct keymap_entry *new_bank = (old_bank == keymap_banks[0]) ? keymap_banks[1] : keymap_banks[0];
+
+    keymap_erase(new_bank);
+
+    if (entry->action != KEYMAP_ACTION_NONE && !keymap_insert(new_bank, entry)) {
+        return false;
+    }
+
+    for (uint16_t i = 1; i < KEYMAP_SLOT_COUNT; i++) {
+        struct keymap_entry old_entry = { old_bank[i].address, old_bank[i].code, old_bank[i].action };
+
+        if (keymap_entry_empty(&old_entry) || old_entry.action == KEYMAP_ACTION_NONE) {
+            continue;
+        }
+
+        if (old_entry.address == entry->address && old_entry.code == entry->code) {
+            continue;
+        }
+
+        // Without a header the new bank is never used, the next attempt erases it again
+        if (!keymap_insert(new_bank, &old_entry)) {
+            return false;
+        }
+    }
+
+    // The header is written last, so the old bank stays valid if we lose power before this
+    keymap_write_header(new_bank, keymap_header(old_bank)->sequence + 1);
+
+    keymap_active = new_bank;
+
+    keymap_erase(old_bank);
+
+    return true;
+}
+
+void keymap_init() {
+    const volatile struct keymap_header *header_0 = keymap_header(keymap_banks[0]);
+    const volatile struct keymap_header *header_1 = keymap_header(keymap_banks[1]);
+    bool valid_0 = header_0->magic == KEYMAP_MAGIC;
+    bool valid_1 = header_1->magic == KEYMAP_MAGIC;
+
+    if (valid_0 && valid_1) {
+        // Both are valid if we lost power while compacting: the newer one wins
+        keymap_active = ((int8_t) (header_1->sequence - header_0->sequence) > 0) ? keymap_banks[1] : keymap_banks[0];
+    } else if (valid_0) {
+        keymap_active = keymap_banks[0];
+    } else if (valid_1) {
+        keymap_active = keymap_banks[1];
+    } else {
+        keymap_active = keymap_banks[0];
+
+        keymap_erase(keymap_active);
+
+        for (uint8_t i = 0; i < ARRAY_SIZE(keymap_defaults); i++) {
+            keymap_insert(keymap_active, &keymap_defaults[i]);
+        }
+
+        keymap_write_header(keymap_active, 0);
+    }
+}
+
+uint8_t keymap_lookup(uint16_t address, uint8_t code) {
+    uint8_t index = keymap_find_slot(keymap_active, address, code);
+
+    if (index == 0 || keymap_entry_empty(&keymap_active[index])) {
+        return KEYMAP_ACTION_NONE;
+    }
+
+    return keymap_active[index].action;
+}
+
+bool keymap_store(uint16_t address, uint8_t code, uint8_t action) {
+    // This key can't be told apart from an empty slot
+    if (address == KEYMAP_EMPTY_ADDRESS && code == KEYMAP_EMPTY_CODE) {
+        return false;
+    }
+
+    struct keymap_entry entry = { address, code, action };
+
+    uint8_t index = keymap_find_slot(keymap_active, address, code);
+
+    if (index != 0 && keymap_entry_empty(&keymap_active[index])) {
+        // Erased slot: can be programmed directly
+        if (action != KEYMAP_ACTION_NONE) {
+            flash_write((const void *) &keymap_active[index], &entry, sizeof(entry));
+        }
+    } else if (index == 0 || keymap_active[index].action != action) {
+        return keymap_compact(&entry);
+    }
+
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <shared/commands.h>
+
+// A keymap action is the slave command that is sent when the key is pressed.
+//   A single key can't produce an extended command (00001xxx), so that range
+//   is borrowed for actions that are resolved on the slave.
+#define KEYMAP_ACTION_NONE SLAVE_COMMAND_NONE
+// Brightness or speed, depending on the master's mode
+#define KEYMAP_ACTION_UP 0x08
+#define KEYMAP_ACTION_DOWN 0x09
+
+// Load the keymap from flash, writing the default keymap if there is none yet
+void keymap_init();
+// Constant time lookup of the action mapped to a key, KEYMAP_ACTION_NONE if the key is unknown
+uint8_t keymap_lookup(uint16_t address, uint8_t code);
+// Map a key to an action and persist it in flash. Returns false and leaves the keymap
+//   as it is if the key can't be stored without dropping another one
+bool keymap_store(uint16_t address, uint8_t code, uint8_t action);
@@ -6,45 +6,34 @@
 #include <stdbool.h>
 
 #include <shared/commands.h>
-#include <shared/i2c.h>
+#include <shared/slave.h>
+#include <shared/flash.h>
 
-#define SLAVE_ADDRESS 0x11
+#include "nec.h"
+#include "keymap.h"
 
-#define TIME_TOLERANCE 0.5f
-#define TIME_MIN(expected) ((uint16_t) ((expected) * (1.0f - TIME_TOLERANCE)))
-#define TIME_MAX(expected) ((uint16_t) ((expected) * (1.0f + TIME_TOLERANCE)))
+#define SLAVE_ADDRESS 0x11
 
-#define NEC_ADDRESS 0x00ef
+// Holding the OFF key for this many repeat codes (~3 s) enters learning mode,
+//   holding it again leaves without learning anything
+#define LEARN_HOLD_REPEAT_COUNT 28
+// Learning mode is also left if no key is pressed for this long (us)
+#define LEARN_TIMEOUT (20UL * 1000000)
 
 #define SENSOR_BIT BIT1
 
-#define NEC_START_PULSE_LENGTH ((uint16_t) (562.5f * 16))
-#define NEC_START_PAUSE_LENGTH ((uint16_t) (562.5f * 8))
-#define NEC_REPEAT_PAUSE_LENGTH ((uint16_t) (562.5f * 4))
-#define NEC_BIT_PULSE_LENGTH ((uint16_t) (562.5f * 1))
-#define NEC_BIT_0_PAUSE_LENGTH ((uint16_t) (562.5f * 1))
-#define NEC_BIT_1_PAUSE_LENGTH ((uint16_t) (562.5f * 3))
-#define NEC_BIT_PAUSE_LENGTH_MID ((NEC_BIT_0_PAUSE_LENGTH + NEC_BIT_1_PAUSE_LENGTH) / 2)
-#define NEC_START_REPEAT_PAUSE_LENGTH_MID ((NEC_START_PAUSE_LENGTH + NEC_REPEAT_PAUSE_LENGTH) / 2)
-
-enum nec_state {
-    NEC_STATE_IDLE,
-    NEC_STATE_START,
-    NEC_STATE_BIT_PAUSE,
-    NEC_STATE_BIT_PULSE
-};
+// The awake time is reported to the master over windows of 2^20 us (~1 s)
+#define DUTY_WINDOW_LENGTH (1UL << 20)
 
-static volatile uint16_t nec_buffer[66];
-static volatile uint16_t nec_buffer_index = 0;
-static volatile bool nec_buffer_full = false, nec_received_repeat = false;
-static uint16_t nec_last_address;
-static uint8_t nec_last_command;
+// Set by the interrupts that have work for the main loop
+static volatile bool wake_pending = false;
 
-static volatile bool master_mode_animated = false;
+static volatile uint16_t duty_timer_overflows = 0;
 
-static void process_nec_buffer();
-
-static void handle_command(uint8_t addr, uint8_t cmd, bool repeated);
+static void handle_command(uint16_t address, uint8_t code, bool repeated);
+static void learn_timeout(uint32_t now);
+static uint32_t duty_time();
+static void report_duty(uint32_t elapsed, uint32_t asleep);
 
 int main() {
     // Disable the watchdog timer
@@ -54,6 +43,11 @@ int main() {
     BCSCTL1 = CALBC1_8MHZ;
     DCOCTL = CALDCO_8MHZ;
 
+    // 8 MHz / 20 = 400 kHz flash timing generator
+    flash_init(20);
+
+    keymap_init();
+
     // Configure all pins as outputs
     P1DIR = 0xff;
     P2DIR = 0xff;
@@ -66,140 +60,189 @@ int main() {
     // TACLK = 1 MHz; t = 1 / TACLK = 1 us; 16-bit-timer => interrupt every 65.536 ms
     TA0CCTL0 = CAP | CM_3 | SCS | CCIE;
 
+    // Initialize Timer_A1 as time base for the duty cycle (Timer_A0 is cleared by the decoder)
+    // SMCLK divided by 8 (1 MHz), 'Continous up' mode, count overflows
+    TA1CTL = TASSEL_2 | ID_3 | MC_2 | TAIE;
+
     P1DIR &= ~SENSOR_BIT;
     P1SEL |= SENSOR_BIT;
 
-    i2c_init_slave(SLAVE_ADDRESS, true);
-
-    IE2 |= UCB0RXIE | UCB0TXIE;
+    slave_init(SLAVE_ADDRESS, NULL);
 
     __enable_interrupt();
 
+    uint32_t duty_window_start = duty_time();
+    uint32_t duty_asleep = 0;
+
     while (1) {
-        if (nec_buffer_full) {
-            process_nec_buffer();
+        uint16_t address;
+        uint8_t command;
 
-            nec_buffer_full = false;
+        switch (nec_poll(&address, &command)) {
+            case NEC_EVENT_FRAME:
+                handle_command(address, command, false);
+                break;
+            case NEC_EVENT_REPEAT:
+                handle_command(address, command, true);
+                break;
+            default:
+                break;
         }
 
-        if (nec_received_repeat) {
-            handle_command(nec_last_address, nec_last_command, true);
+        uint32_t sleep_start = duty_time();
 
-            nec_received_repeat = false;
+        // LPM0 keeps SMCLK running for the timers and the I2C slave
+        __disable_interrupt();
+        if (!wake_pending) {
+            // Enable interrupts and sleep at once, so that no wake-up gets lost
+            __bis_SR_register(LPM0_bits | GIE);
+            __disable_interrupt();
         }
-    }
-}
+        wake_pending = false;
+        __enable_interrupt();
 
-#define SLAVE_COMMAND_QUEUE_SIZE 16
-static volatile uint8_t slave_command_queue[SLAVE_COMMAND_QUEUE_SIZE];
-static volatile uint8_t slave_command_queue_front = 0;
-static volatile uint8_t slave_command_queue_back = 0;
+        // The timer overflow wakes us up at least every 65 ms
+        uint32_t now = duty_time();
+        duty_asleep += now - sleep_start;
 
-static void enqueue_slave_command(uint8_t command) {
-    __istate_t s = __get_interrupt_state();
-    __disable_interrupt();
+        learn_timeout(now);
 
-    uint8_t old_back = slave_command_queue_back;
-    uint8_t new_back = (old_back + 1) & (SLAVE_COMMAND_QUEUE_SIZE - 1);
-    if (new_back != slave_command_queue_front) {
-        slave_command_queue[old_back] = command;
-        slave_command_queue_back = new_back;
-    }
+        if (now - duty_window_start >= DUTY_WINDOW_LENGTH) {
+            report_duty(now - duty_window_start, duty_asleep);
 
-    __set_interrupt_state(s);
+            duty_window_start = now;
+            duty_asleep = 0;
+        }
+    }
 }
 
-static uint8_t dequeue_slave_command() {
-    uint8_t command = SLAVE_COMMAND_NONE;
-
-    __istate_t s = __get_interrupt_state();
+// Microseconds since startup
+static uint32_t duty_time() {
     __disable_interrupt();
 
-    uint8_t old_front = slave_command_queue_front;
-    uint8_t new_front = (old_front + 1) & (SLAVE_COMMAND_QUEUE_SIZE - 1);
-    if (new_front != ((slave_command_queue_back + 1) & (SLAVE_COMMAND_QUEUE_SIZE - 1))) {
-        command = slave_command_queue[old_front];
-        slave_command_queue_front = new_front;
+    uint16_t overflows = duty_timer_overflows;
+    uint16_t count = TA1R;
+
+    // The timer overflowed, but the interrupt hasn't counted it yet
+    if ((TA1CTL & TAIFG) && count < 0x8000) {
+        overflows++;
     }
 
-    __set_interrupt_state(s);
+    __enable_interrupt();
 
-    return command;
+    return (uint32_t) overflows << 16 | count;
 }
 
-static void process_nec_buffer() {
-    uint8_t bytes[4] = {0};
-    uint8_t bit_index = 0;
+static void report_duty(uint32_t elapsed, uint32_t asleep) {
+    // Don't hold back key presses
+    if (slave_queue_count() != 0) {
+        return;
+    }
+
+    uint8_t report[] = {
+        EXTENDED_COMMAND_SLAVE_DUTY,
+        SLAVE_ADDRESS,
+        ((elapsed - asleep) * 100) / elapsed
+    };
+
+    slave_enqueue_extended(report, sizeof(report));
+}
 
-    for (uint8_t i = 2; i < 66; i++) {
-        bool is_pulse = !(i & 1);
-        uint16_t length = nec_buffer[i];
+enum learn_state {
+    LEARN_STATE_IDLE,
+    // Waiting for a known key whose action is to be learned
+    LEARN_STATE_SELECT,
+    // Waiting for the new key
+    LEARN_STATE_CAPTURE
+};
 
-        if (is_pulse) {
-            if (length < TIME_MIN(NEC_BIT_PULSE_LENGTH) || length > TIME_MAX(NEC_BIT_PULSE_LENGTH)) {
-                return;
+static enum learn_state learn_state = LEARN_STATE_IDLE;
+static uint8_t learn_action;
+// Time of the last key press in learning mode
+static uint32_t learn_time;
+static uint8_t repeat_count = 0;
+
+static void learn(uint16_t address, uint8_t code, uint8_t action) {
+    switch (learn_state) {
+        case LEARN_STATE_SELECT:
+            if (action != KEYMAP_ACTION_NONE) {
+                learn_action = action;
+                learn_state = LEARN_STATE_CAPTURE;
             }
-        } else {
-            if (length < TIME_MIN(NEC_BIT_0_PAUSE_LENGTH) || length > TIME_MAX(NEC_BIT_1_PAUSE_LENGTH)) {
-                return;
+            break;
+        case LEARN_STATE_CAPTURE:
+            // Keys that turn the lights off keep their action, they are the way out of learning mode
+            if (action == SLAVE_COMMAND_OFF) {
+                break;
             }
 
-            if (length > NEC_BIT_PAUSE_LENGTH_MID) {
-                bytes[bit_index / 8] |= 1 << (bit_index % 8);
-            }
+            learn_state = LEARN_STATE_IDLE;
 
-            bit_index++;
-        }
+            // The lights are off since OFF was held, turn them on as confirmation. They stay
+            //   off if the keymap has no room for the key without dropping another one
+            if (keymap_store(address, code, learn_action)) {
+                slave_enqueue(SLAVE_COMMAND_ON);
+            }
+            break;
+        default:
+            break;
     }
+}
 
-    if (bytes[2] == (uint8_t) ~bytes[3]) {
-        uint16_t address = bytes[0] << 8 | bytes[1];
-        uint8_t command = bytes[2];
+// Leave learning mode if no key was pressed for LEARN_TIMEOUT, the lights stay off
+static void learn_timeout(uint32_t now) {
+    if (learn_state != LEARN_STATE_IDLE && now - learn_time >= LEARN_TIMEOUT) {
+        learn_state = LEARN_STATE_IDLE;
+    }
+}
 
-        handle_command(address, command, false);
+static void handle_command(uint16_t address, uint8_t code, bool repeated) {
+    uint8_t action = keymap_lookup(address, code);
 
-        nec_last_address = address;
-        nec_last_command = command;
+    if (repeated) {
+        if (repeat_count < 0xff) {
+            repeat_count++;
+        }
+    } else {
+        repeat_count = 0;
     }
-}
 
-static void handle_command(uint8_t address, uint8_t command, bool repeated) {
-    if (address != NEC_ADDRESS) {
+    if (learn_state != LEARN_STATE_IDLE) {
+        learn_time = duty_time();
+
+        if (!repeated) {
+            learn(address, code, action);
+        } else if (action == SLAVE_COMMAND_OFF && repeat_count == LEARN_HOLD_REPEAT_COUNT) {
+            // Held again, the lights stay off
+            learn_state = LEARN_STATE_IDLE;
+        }
         return;
     }
 
-    switch (command) {
-        case 0: if (master_mode_animated) { enqueue_slave_command(SLAVE_COMMAND_SPEED_INCREMENT); } else { enqueue_slave_command(SLAVE_COMMAND_BRIGHTNESS_INCREMENT); } break;
-        case 1: if (master_mode_animated) { enqueue_slave_command(SLAVE_COMMAND_SPEED_DECREMENT); } else { enqueue_slave_command(SLAVE_COMMAND_BRIGHTNESS_DECREMENT); } break;
-        case 2: enqueue_slave_command(SLAVE_COMMAND_OFF); break;
-        case 3: enqueue_slave_command(SLAVE_COMMAND_ON); break;
-        case 4: enqueue_slave_command(SLAVE_COMMAND_COLOR(0)); break;
-        case 5: enqueue_slave_command(SLAVE_COMMAND_COLOR(5)); break;
-        case 6: enqueue_slave_command(SLAVE_COMMAND_COLOR(10)); break;
-        case 7: enqueue_slave_command(SLAVE_COMMAND_COLOR(15)); break;
-        case 8: enqueue_slave_command(SLAVE_COMMAND_COLOR(1)); break;
-        case 9: enqueue_slave_command(SLAVE_COMMAND_COLOR(6)); break;
-        case 10: enqueue_slave_command(SLAVE_COMMAND_COLOR(11)); break;
-        case 11: enqueue_slave_command(SLAVE_COMMAND_ANIMATION(0)); break;
-        case 12: enqueue_slave_command(SLAVE_COMMAND_COLOR(2)); break;
-        case 13: enqueue_slave_command(SLAVE_COMMAND_COLOR(7)); break;
-        case 14: enqueue_slave_command(SLAVE_COMMAND_COLOR(12)); break;
-        case 15: enqueue_slave_command(SLAVE_COMMAND_ANIMATION(1)); break;
-        case 16: enqueue_slave_command(SLAVE_COMMAND_COLOR(3)); break;
-        case 17: enqueue_slave_command(SLAVE_COMMAND_COLOR(8)); break;
-        case 18: enqueue_slave_command(SLAVE_COMMAND_COLOR(13)); break;
-        case 19: enqueue_slave_command(SLAVE_COMMAND_ANIMATION(2)); break;
-        case 20: enqueue_slave_command(SLAVE_COMMAND_COLOR(4)); break;
-        case 21: enqueue_slave_command(SLAVE_COMMAND_COLOR(9)); break;
-        case 22: enqueue_slave_command(SLAVE_COMMAND_COLOR(14)); break;
-        case 23: enqueue_slave_command(SLAVE_COMMAND_ANIMATION(3)); break;
+    switch (action) {
+        case KEYMAP_ACTION_NONE:
+            break;
+        case KEYMAP_ACTION_UP:
+            slave_enqueue(slave_master_mode_animated ? SLAVE_COMMAND_SPEED_INCREMENT : SLAVE_COMMAND_BRIGHTNESS_INCREMENT);
+            break;
+        case KEYMAP_ACTION_DOWN:
+            slave_enqueue(slave_master_mode_animated ? SLAVE_COMMAND_SPEED_DECREMENT : SLAVE_COMMAND_BRIGHTNESS_DECREMENT);
+            break;
+        case SLAVE_COMMAND_OFF:
+            if (repeat_count == LEARN_HOLD_REPEAT_COUNT) {
+                learn_state = LEARN_STATE_SELECT;
+                learn_time = duty_time();
+            } else {
+                slave_enqueue(SLAVE_COMMAND_OFF);
+            }
+            break;
+        default:
+            slave_enqueue(action);
+            break;
     }
 }
 
-#define NEC_REPEAT_TIMEOUT_COUNTER_LIMIT 4 // ~260 ms
-
 static volatile uint16_t last_TA0CCR0 = 0;
-static volatile uint16_t nec_repeat_timeout_counter = NEC_REPEAT_TIMEOUT_COUNTER_LIMIT;
 
 __attribute__((interrupt(TIMER0_A0_VECTOR)))
 void TIMER0_A0_ISR() {
@@ -213,51 +256,13 @@ void TIMER0_A0_ISR() {
     //     TA0CCTL0 &= ~COV;
     // }
 
-    uint16_t buffer_index = nec_buffer_index;
-
-    if (buffer_index == 0) {
+    if (nec_edge(length, is_pulse)) {
         TA0CTL |= TACLR;
         last_TA0CCR0 = 0;
-
-        if (!is_pulse || (length < TIME_MIN(NEC_START_PULSE_LENGTH) || length > TIME_MAX(NEC_START_PULSE_LENGTH))) {
-            return;
-        }
     }
 
-    if (buffer_index == 1) {
-        if (length < TIME_MIN(NEC_REPEAT_PAUSE_LENGTH) || length > TIME_MAX(NEC_START_PAUSE_LENGTH)) {
-            nec_buffer_index = 0;
-            return;
-        }
-
-        if (length < NEC_START_REPEAT_PAUSE_LENGTH_MID) {
-            if (nec_repeat_timeout_counter < NEC_REPEAT_TIMEOUT_COUNTER_LIMIT) {
-                nec_received_repeat = true;
-
-                nec_repeat_timeout_counter = 0;
-            }
-
-            nec_buffer_index = 0;
-            return;
-        }
-
-        nec_repeat_timeout_counter = 0;
-    }
-
-    if (nec_buffer_full) {
-        return;
-    }
-
-    nec_buffer[buffer_index] = length;
-
-    buffer_index++;
-    if (buffer_index == 66) {
-        buffer_index = 0;
-
-        nec_buffer_full = true;
-    }
-
-    nec_buffer_index = buffer_index;
+    wake_pending = true;
+    __bic_SR_register_on_exit(LPM0_bits);
 }
 
 __attribute__((interrupt(TIMER0_A1_VECTOR)))
@@ -266,29 +271,15 @@ void TIMER0_A1_ISR() {
 
     last_TA0CCR0 = 0;
 
-    nec_buffer_index = 0;
+    nec_timeout();
 
-    if (nec_repeat_timeout_counter < NEC_REPEAT_TIMEOUT_COUNTER_LIMIT) {
-        nec_repeat_timeout_counter++;
-    }
+    wake_pending = true;
+    __bic_SR_register_on_exit(LPM0_bits);
 }
 
-__attribute__((interrupt(USCIAB0TX_VECTOR)))
-void USCIAB0TX_ISR() {
-    if (IFG2 & UCB0RXIFG) {
-        uint8_t master_command = UCB0RXBUF;
-
-        switch (master_command) {
-            case MASTER_COMMAND_ANIMATION_OFF:
-                master_mode_animated = false;
-                break;
-            case MASTER_COMMAND_ANIMATION_ON:
-                master_mode_animated = true;
-                break;
-        }
-    }
+__attribute__((interrupt(TIMER1_A1_VECTOR)))
+void TIMER1_A1_ISR() {
+    TA1CTL &= ~TAIFG;
 
-    if (IFG2 & UCB0TXIFG) {
-        UCB0TXBUF = dequeue_slave_command();
-    }
+    duty_timer_overflows++;
 }
@@ -0,0 +1,126 @@
+#include "nec.h"
+
+static volatile uint16_t nec_buffer[NEC_BUFFER_LENGTH];
+static volatile uint16_t nec_buffer_index = 0;
+static volatile bool nec_buffer_full = false, nec_received_repeat = false;
+static volatile uint16_t nec_repeat_timeout_counter = NEC_REPEAT_TIMEOUT_COUNTER_LIMIT;
+static uint16_t nec_last_address;
+static uint8_t nec_last_command;
+
+bool nec_edge(uint16_t length, bool is_pulse) {
+    uint16_t buffer_index = nec_buffer_index;
+
+    if (buffer_index == 0) {
+        if (!is_pulse || (length < TIME_MIN(NEC_START_PULSE_LENGTH) || length > TIME_MAX(NEC_START_PULSE_LENGTH))) {
+            return true;
+        }
+    }
+
+    if (buffer_index == 1) {
+        if (length < TIME_MIN(NEC_REPEAT_PAUSE_LENGTH) || length > TIME_MAX(NEC_START_PAUSE_LENGTH)) {
+            nec_buffer_index = 0;
+            return false;
+        }
+
+        if (length < NEC_START_REPEAT_PAUSE_LENGTH_MID) {
+            if (nec_repeat_timeout_counter < NEC_REPEAT_TIMEOUT_COUNTER_LIMIT) {
+                nec_received_repeat = true;
+
+                nec_repeat_timeout_counter = 0;
+            }
+
+            nec_buffer_index = 0;
+            return false;
+        }
+
+        nec_repeat_timeout_counter = 0;
+    }
+
+    if (nec_buffer_full) {
+        return buffer_index == 0;
+    }
+
+    nec_buffer[buffer_index] = length;
+
+    bool restart = buffer_index == 0;
+
+    buffer_index++;
+    if (buffer_index == NEC_BUFFER_LENGTH) {
+        buffer_index = 0;
+
+        nec_buffer_full = true;
+    }
+
+    nec_buffer_index = buffer_index;
+
+    return restart;
+}
+
+void nec_timeout() {
+    nec_buffer_index = 0;
+
+    if (nec_repeat_timeout_counter < NEC_REPEAT_TIMEOUT_COUNTER_LIMIT) {
+        nec_repeat_timeout_counter++;
+    }
+}
+
+static bool decode_nec_buffer(uint16_t *address, uint8_t *command) {
+    uint8_t bytes[4] = {0};
+    uint8_t bit_index = 0;
+
+    for (uint8_t i = 2; i < NEC_BUFFER_LENGTH; i++) {
+        bool is_pulse = !(i & 1);
+        uint16_t length = nec_buffer[i];
+
+        if (is_pulse) {
+            if (length < TIME_MIN(NEC_BIT_PULSE_LENGTH) || length > TIME_MAX(NEC_BIT_PULSE_LENGTH)) {
+                return false;
+            }
+        } else {
+            if (length < TIME_MIN(NEC_BIT_0_PAUSE_LENGTH) || length > TIME_MAX(NEC_BIT_1_PAUSE_LENGTH)) {
+                return false;
+            }
+
+            if (length > NEC_BIT_PAUSE_LENGTH_MID) {
+                bytes[bit_index / 8] |= 1 << (bit_index % 8);
+            }
+
+            bit_index++;
+        }
+    }
+
+    if ((uint8_t) (bytes[2] ^ bytes[3]) != 0xff) {
+        return false;
+    }
+
+    *address = (uint16_t) bytes[0] << 8 | bytes[1];
+    *command = bytes[2];
+
+    return true;
+}
+
+enum nec_event nec_poll(uint16_t *address, uint8_t *command) {
+    if (nec_buffer_full) {
+        bool valid = decode_nec_buffer(address, command);
+
+        nec_buffer_full = false;
+
+        if (valid) {
+            nec_last_address = *address;
+            nec_last_command = *command;
+
+            return NEC_EVENT_FRAME;
+        }
+    }
+
+    if (nec_received_repeat) {
+        nec_received_repeat = false;
+
+        *address = nec_last_address;
+        *command = nec_last_command;
+
+        return NEC_EVENT_REPEAT;
+    }
+
+    return NEC_EVENT_NONE;
+}
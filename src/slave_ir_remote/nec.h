@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Timer ticks are expected to be 1 us long
+
+#define TIME_TOLERANCE 0.5f
+#define TIME_MIN(expected) ((uint16_t) ((expected) * (1.0f - TIME_TOLERANCE)))
+#define TIME_MAX(expected) ((uint16_t) ((expected) * (1.0f + TIME_TOLERANCE)))
+
+#define NEC_START_PULSE_LENGTH ((uint16_t) (562.5f * 16))
+#define NEC_START_PAUSE_LENGTH ((uint16_t) (562.5f * 8))
+#define NEC_REPEAT_PAUSE_LENGTH ((uint16_t) (562.5f * 4))
+#define NEC_BIT_PULSE_LENGTH ((uint16_t) (562.5f * 1))
+#define NEC_BIT_0_PAUSE_LENGTH ((uint16_t) (562.5f * 1))
+#define NEC_BIT_1_PAUSE_LENGTH ((uint16_t) (562.5f * 3))
+#define NEC_BIT_PAUSE_LENGTH_MID ((NEC_BIT_0_PAUSE_LENGTH + NEC_BIT_1_PAUSE_LENGTH) / 2)
+#define NEC_START_REPEAT_PAUSE_LENGTH_MID ((NEC_START_PAUSE_LENGTH + NEC_REPEAT_PAUSE_LENGTH) / 2)
+
+// Number of timer overflows after a frame during which repeat codes are accepted
+#define NEC_REPEAT_TIMEOUT_COUNTER_LIMIT 4 // ~260 ms
+
+#define NEC_BUFFER_LENGTH 66
+
+enum nec_event {
+    NEC_EVENT_NONE,
+    NEC_EVENT_FRAME,
+    NEC_EVENT_REPEAT
+};
+
+// The decoder does not touch any hardware registers, so it can just as well be
+//   fed with recorded edge timings as with the timer capture values
+
+// Feed the time since the previous edge into the decoder (called from the capture ISR).
+//   Returns true if the caller has to restart its time base at this edge
+bool nec_edge(uint16_t length, bool is_pulse);
+// Tell the decoder that the 16-bit time base overflowed (called from the overflow ISR)
+void nec_timeout();
+// Decode pending frames/repeat codes (called from the main loop)
+enum nec_event nec_poll(uint16_t *address, uint8_t *command);
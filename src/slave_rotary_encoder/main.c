@@ -0,0 +1,193 @@
+#include <msp430.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <shared/commands.h>
+#include <shared/slave.h>
+
+#define SLAVE_ADDRESS 0x12
+
+// All inputs are on port 2, active low with internal pull-ups
+#define ENCODER_A BIT0
+#define ENCODER_B BIT1
+// Push button of the encoder
+#define BUTTON_POWER BIT2
+#define BUTTON_COLOR BIT3
+#define BUTTON_ANIMATION BIT4
+
+#define ENCODER_PINS (ENCODER_A | ENCODER_B)
+#define BUTTON_PINS (BUTTON_POWER | BUTTON_COLOR | BUTTON_ANIMATION)
+
+// Most encoders go through all 4 quadrature states between two detents
+#define ENCODER_STEPS_PER_DETENT 4
+
+// Buttons are ignored for this many watchdog intervals (~1 ms) after an edge
+#define BUTTON_DEBOUNCE_TICKS 20
+
+#define COLOR_COUNT 16
+
+// Quadrature state transitions, indexed by (previous state << 2) | new state.
+//   Invalid transitions (both inputs changed, i.e. bounce) count as 0
+static const int8_t ENCODER_TRANSITIONS[16] = {
+    0, -1, 1, 0,
+    1, 0, 0, -1,
+    -1, 0, 0, 1,
+    0, 1, -1, 0
+};
+
+static volatile int16_t encoder_steps = 0;
+static uint8_t encoder_state;
+
+static volatile uint8_t button_presses = 0;
+static volatile uint8_t button_debounce_ticks = 0;
+
+static uint8_t selected_color = 0;
+static uint8_t selected_animation = 0;
+
+static uint8_t read_encoder_state() {
+    uint8_t in = P2IN;
+
+    return ((in & ENCODER_A) ? 2 : 0) | ((in & ENCODER_B) ? 1 : 0);
+}
+
+// Take the whole detents out of the accumulated encoder steps, leave the rest
+static int16_t take_encoder_detents() {
+    __disable_interrupt();
+
+    int16_t detents = encoder_steps / ENCODER_STEPS_PER_DETENT;
+    encoder_steps -= detents * ENCODER_STEPS_PER_DETENT;
+
+    __enable_interrupt();
+
+    return detents;
+}
+
+int main() {
+    // Disable the watchdog timer
+    WDTCTL = WDTPW | WDTHOLD;
+
+    // Configure the microcontroller to run at 8 MHz
+    BCSCTL1 = CALBC1_8MHZ;
+    DCOCTL = CALDCO_8MHZ;
+
+    // Configure all pins as outputs
+    P1DIR = 0xff;
+    P2DIR = 0xff;
+    // Configure P2.6 and P2.7 as normal GPIOs (they are configured as XIN and XOUT on reset)
+    P2SEL = 0x00;
+
+    // Inputs with pull-ups
+    P2DIR &= ~(ENCODER_PINS | BUTTON_PINS);
+    P2OUT |= ENCODER_PINS | BUTTON_PINS;
+    P2REN |= ENCODER_PINS | BUTTON_PINS;
+
+    // The encoder needs both edges: wait for the opposite of the current level on each pin
+    encoder_state = read_encoder_state();
+    P2IES = (P2IES & ~ENCODER_PINS) | (P2IN & ENCODER_PINS);
+    // Buttons trigger when pressed (falling edge)
+    P2IES |= BUTTON_PINS;
+    P2IFG = 0;
+    P2IE |= ENCODER_PINS | BUTTON_PINS;
+
+    // Watchdog as interval timer for debouncing: SMCLK / 8192 -> ~1 ms @ 8 MHz
+    WDTCTL = WDT_MDLY_8;
+    IE1 |= WDTIE;
+
+    slave_init(SLAVE_ADDRESS, NULL);
+
+    __enable_interrupt();
+
+    while (1) {
+        // Only hand out a new delta once the master fetched the previous one.
+        //   Detents keep accumulating in the meantime, so fast spins turn into
+        //   a few large steps instead of flooding the bus with single ones.
+        if (slave_queue_count() == 0) {
+            int16_t detents = take_encoder_detents();
+
+            if (detents != 0) {
+                // Whatever doesn't fit into one command is sent with the next one
+                int16_t delta = detents;
+                if (delta < SLAVE_COMMAND_DELTA_MIN) {
+                    delta = SLAVE_COMMAND_DELTA_MIN;
+                } else if (delta > SLAVE_COMMAND_DELTA_MAX) {
+                    delta = SLAVE_COMMAND_DELTA_MAX;
+                }
+
+                if (delta != detents) {
+                    __disable_interrupt();
+                    encoder_steps += (detents - delta) * ENCODER_STEPS_PER_DETENT;
+                    __enable_interrupt();
+                }
+
+                if (slave_master_mode_animated) {
+                    slave_enqueue(SLAVE_COMMAND_SPEED_DELTA(delta));
+                } else {
+                    slave_enqueue(SLAVE_COMMAND_BRIGHTNESS_DELTA(delta));
+                }
+            }
+        }
+
+        __disable_interrupt();
+        uint8_t presses = button_presses;
+        button_presses = 0;
+        __enable_interrupt();
+
+        if (presses & BUTTON_POWER) {
+            slave_enqueue(SLAVE_COMMAND_TOGGLE);
+        }
+
+        if (presses & BUTTON_COLOR) {
+            slave_enqueue(SLAVE_COMMAND_COLOR(selected_color));
+
+            selected_color = (selected_color + 1) % COLOR_COUNT;
+        }
+
+        if (presses & BUTTON_ANIMATION) {
+            slave_enqueue(SLAVE_COMMAND_ANIMATION(selected_animation));
+
+            selected_animation = (selected_animation + 1) % SLAVE_ANIMATION_COUNT;
+        }
+    }
+}
+
+__attribute__((interrupt(PORT2_VECTOR)))
+void PORT2_ISR() {
+    uint8_t flags = P2IFG;
+
+    if (flags & ENCODER_PINS) {
+        P2IFG &= ~ENCODER_PINS;
+
+        // Follow the inputs with the edge selection so that every change triggers
+        uint8_t in = P2IN;
+        P2IES = (P2IES & ~ENCODER_PINS) | (in & ENCODER_PINS);
+
+        uint8_t new_state = ((in & ENCODER_A) ? 2 : 0) | ((in & ENCODER_B) ? 1 : 0);
+
+        encoder_steps += ENCODER_TRANSITIONS[(encoder_state << 2) | new_state];
+        encoder_state = new_state;
+    }
+
+    if (flags & BUTTON_PINS) {
+        P2IFG &= ~BUTTON_PINS;
+
+        button_presses |= flags & BUTTON_PINS;
+
+        // Ignore the bouncing that follows
+        P2IE &= ~BUTTON_PINS;
+        button_debounce_ticks = BUTTON_DEBOUNCE_TICKS;
+    }
+}
+
+__attribute__((interrupt(WDT_VECTOR)))
+void WDT_ISR() {
+    if (button_debounce_ticks > 0) {
+        button_debounce_ticks--;
+
+        if (button_debounce_ticks == 0) {
+            P2IFG &= ~BUTTON_PINS;
+            P2IE |= BUTTON_PINS;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#include "goertzel.h"
+
+// (value * 2 * cos(2 * pi * k / N)) >> 14 for each band. The Q14 coefficients
+//   (32610, 32138, 30274, 23170, 0, -23170) are split into a few signed powers
+//   of two. Every term is shifted on from the previous one, which keeps the
+//   32-bit shifts short
+
+// 32610 = 2^15 - 2^7 - 2^5 + 2^1
+static int32_t multiply_k1(int32_t value) {
+    int32_t a = value >> 7;
+    int32_t b = a >> 2;
+    int32_t c = b >> 4;
+
+    return value + value - a - b + c;
+}
+
+// 32138 = 2^15 - 2^9 - 2^7 + 2^3 + 2^1
+static int32_t multiply_k2(int32_t value) {
+    int32_t a = value >> 5;
+    int32_t b = a >> 2;
+    int32_t c = b >> 4;
+    int32_t d = c >> 2;
+
+    return value + value - a - b + c + d;
+}
+
+// 30274 = 2^15 - 2^11 - 2^9 + 2^6 + 2^1
+static int32_t multiply_k4(int32_t value) {
+    int32_t a = value >> 3;
+    int32_t b = a >> 2;
+    int32_t c = b >> 3;
+    int32_t d = c >> 5;
+
+    return value + value - a - b + c + d;
+}
+
+// 23170 = 2^14 + 2^13 - 2^10 - 2^9 + 2^7 + 2^1
+static int32_t multiply_k8(int32_t value) {
+    int32_t a = value >> 1;
+    int32_t b = a >> 3;
+    int32_t c = b >> 1;
+    int32_t d = c >> 2;
+    int32_t e = d >> 6;
+
+    return value + a - b - c + d + e;
+}
+
+static int32_t multiply_k16(int32_t value) {
+    (void) value;
+
+    return 0;
+}
+
+static int32_t multiply_k24(int32_t value) {
+    return -multiply_k8(value);
+}
+
+// One per entry of GOERTZEL_BANDS
+static int32_t (*const GOERTZEL_MULTIPLY[GOERTZEL_BAND_COUNT])(int32_t value) = {
+    multiply_k1,
+    multiply_k2,
+    multiply_k4,
+    multiply_k8,
+    multiply_k16,
+    multiply_k24
+};
+
+// 8 * log2(value), using the three bits below the MSB as the fraction
+static uint8_t log2_q3(uint32_t value) {
+    if (value == 0) {
+        return 0;
+    }
+
+    uint8_t exponent = 31;
+    while (!(value & 0x80000000)) {
+        value <<= 1;
+        exponent--;
+    }
+
+    return exponent << 3 | ((value >> 28) & 0x07);
+}
+
+void goertzel_analyze(const uint16_t *samples, uint8_t levels[GOERTZEL_BAND_COUNT]) {
+    for (uint8_t band = 0; band < GOERTZEL_BAND_COUNT; band++) {
+        int32_t (*multiply)(int32_t value) = GOERTZEL_MULTIPLY[band];
+        int32_t s1 = 0, s2 = 0;
+
+        for (uint8_t i = 0; i < GOERTZEL_BLOCK_SIZE; i++) {
+            // Remove the DC offset of the biased input
+            int16_t x = (int16_t) samples[i] - 512;
+
+            int32_t s0 = x + multiply(s1) - s2;
+            s2 = s1;
+            s1 = s0;
+        }
+
+        // The states stay below 2^19, so after this the squares fit easily
+        int16_t a = s1 >> 5;
+        int16_t b = s2 >> 5;
+
+        // power = s1^2 + s2^2 - coeff * s1 * s2
+        int32_t power = (int32_t) a * a + (int32_t) b * b - multiply((int32_t) a * b);
+
+        levels[band] = log2_q3(power > 0 ? power : 0);
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+// Sample rate and block size put the bins 125 Hz apart
+#define GOERTZEL_SAMPLE_RATE 8000
+#define GOERTZEL_BLOCK_SIZE 64
+#define GOERTZEL_BAND_COUNT 6
+
+// Bin index of each band: 125, 250, 500, 1000, 2000 and 3000 Hz.
+//   goertzel.c has a multiplication by the coefficient of each of them
+#define GOERTZEL_BANDS { 1, 2, 4, 8, 16, 24 }
+
+// The kernel only uses shifts and adds in its inner loop (there is no hardware multiplier)
+//   and doesn't depend on the hardware, so it can be built for the host as well.
+
+// Run the filter bank over one block of 10-bit ADC samples and return the
+//   level of each band as 8 * log2(power), i.e. 8 steps per octave (0-255)
+void goertzel_analyze(const uint16_t *samples, uint8_t levels[GOERTZEL_BAND_COUNT]);
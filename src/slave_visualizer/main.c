@@ -0,0 +1,301 @@
+#include <msp430.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <shared/commands.h>
+#include <shared/slave.h>
+
+#include "goertzel.h"
+
+#if GOERTZEL_BAND_COUNT != VISUALIZER_BAND_COUNT
+#error "EXTENDED_COMMAND_VISUALIZER_BANDS carries a different number of bands"
+#endif
+
+#define SLAVE_ADDRESS 0x13
+
+// Line-in, biased to VCC/2 (A0)
+#define AUDIO_INPUT BIT0
+
+// Send every second analysed block to the master -> 62.5 frames per second.
+//   The band levels follow halfway in between
+#define FRAME_BLOCK_DIVIDER 2
+
+// Levels are 8 steps per octave of power. The loudest recent level of each band
+//   maps to 255, 4 octaves below it map to 0
+#define LEVEL_RANGE 32
+// Bands whose recent peak is below this are considered silent
+#define LEVEL_NOISE_FLOOR 80
+// Peaks decay by 1 step every this many blocks (~0.5 s per octave)
+#define PEAK_DECAY_BLOCKS 8
+
+// A beat is a bass level this far above its running average
+#define BEAT_THRESHOLD 12
+// Minimum number of blocks between two beats (~160 ms)
+#define BEAT_HOLDOFF_BLOCKS 20
+
+// The awake time, mostly the analysis, is reported to the master over windows of 2^21 timer ticks (~1 s)
+#define DUTY_WINDOW_LENGTH (1UL << 21)
+
+// Two blocks: the DTC fills one while the other is analysed
+static volatile uint16_t samples[2 * GOERTZEL_BLOCK_SIZE];
+static volatile uint16_t *volatile filled_block = NULL;
+
+static volatile bool visualizer_enabled = false;
+
+static volatile uint16_t duty_timer_overflows = 0;
+
+static uint8_t band_peaks[GOERTZEL_BAND_COUNT];
+static uint8_t peak_decay_counter = 0;
+
+// Running average of the bass level in Q4
+static uint16_t bass_average = 0;
+static uint8_t beat_holdoff = 0;
+
+static void handle_master_command(uint8_t command) {
+    switch (command) {
+        case MASTER_COMMAND_VISUALIZER_ON:
+            visualizer_enabled = true;
+            break;
+        case MASTER_COMMAND_ANIMATION_OFF:
+        case MASTER_COMMAND_ANIMATION_ON:
+            visualizer_enabled = false;
+            break;
+    }
+}
+
+// Automatic gain control: scale a level relative to the band's recent peak
+static uint8_t normalize_level(uint8_t band, uint8_t level) {
+    if (level > band_peaks[band]) {
+        band_peaks[band] = level;
+    }
+
+    uint8_t peak = band_peaks[band];
+
+    if (peak < LEVEL_NOISE_FLOOR || peak - level >= LEVEL_RANGE) {
+        return 0;
+    }
+
+    return 255 - (peak - level) * (256 / LEVEL_RANGE);
+}
+
+static bool detect_beat(uint8_t bass_level) {
+    bool beat = false;
+
+    if (beat_holdoff > 0) {
+        beat_holdoff--;
+    } else if (bass_level >= LEVEL_NOISE_FLOOR && bass_level > (bass_average >> 4) + BEAT_THRESHOLD) {
+        beat = true;
+        beat_holdoff = BEAT_HOLDOFF_BLOCKS;
+    }
+
+    bass_average += bass_level - (bass_average >> 4);
+
+    return beat;
+}
+
+static uint8_t max_u8(uint8_t a, uint8_t b) {
+    return a > b ? a : b;
+}
+
+// Timer ticks (0.5 us) since startup
+static uint32_t duty_time() {
+    __disable_interrupt();
+
+    uint16_t overflows = duty_timer_overflows;
+    uint16_t count = TA1R;
+
+    // The timer overflowed, but the interrupt hasn't counted it yet
+    if ((TA1CTL & TAIFG) && count < 0x8000) {
+        overflows++;
+    }
+
+    __enable_interrupt();
+
+    return (uint32_t) overflows << 16 | count;
+}
+
+static void report_duty(uint32_t elapsed, uint32_t asleep) {
+    // Don't hold back visualizer frames
+    if (slave_queue_count() != 0) {
+        return;
+    }
+
+    uint8_t report[] = {
+        EXTENDED_COMMAND_SLAVE_DUTY,
+        SLAVE_ADDRESS,
+        ((elapsed - asleep) * 100) / elapsed
+    };
+
+    slave_enqueue_extended(report, sizeof(report));
+}
+
+int main() {
+    // Disable the watchdog timer
+    WDTCTL = WDTPW | WDTHOLD;
+
+    // Configure the microcontroller to run at 16 MHz
+    BCSCTL1 = CALBC1_16MHZ;
+    DCOCTL = CALDCO_16MHZ;
+
+    // Configure all pins as outputs
+    P1DIR = 0xff;
+    P2DIR = 0xff;
+    // Configure P2.6 and P2.7 as normal GPIOs (they are configured as XIN and XOUT on reset)
+    P2SEL = 0x00;
+
+    P1DIR &= ~AUDIO_INPUT;
+
+    // Initialize Timer_A0 as sample clock
+    // SMCLK (16 MHz), 'Up' mode, period 2000 -> 8 kHz
+    TA0CTL = TASSEL_2 | MC_1;
+    TA0CCR0 = 16000000 / GOERTZEL_SAMPLE_RATE - 1;
+    // OUT1 rises at the start of every period and triggers a conversion
+    TA0CCTL1 = OUTMOD_7;
+    TA0CCR1 = TA0CCR0 / 2;
+
+    // Initialize Timer_A1 as time base for the duty cycle
+    // SMCLK divided by 8 (2 MHz), 'Continous up' mode, count overflows
+    TA1CTL = TASSEL_2 | ID_3 | MC_2 | TAIE;
+
+    // Initialize ADC10
+    // Repeat single channel A0, triggered by TA0.1, SMCLK / 4 (4 MHz)
+    ADC10CTL1 = INCH_0 | SHS_1 | ADC10DIV_3 | ADC10SSEL_3 | CONSEQ_2;
+    // VCC/VSS reference, 16 clock sample time, interrupt after each DTC block
+    ADC10CTL0 = SREF_0 | ADC10SHT_2 | ADC10ON | ADC10IE;
+    ADC10AE0 = AUDIO_INPUT;
+
+    // Data transfer controller: two blocks, continuously
+    ADC10DTC0 = ADC10TB | ADC10CT;
+    ADC10DTC1 = GOERTZEL_BLOCK_SIZE;
+    ADC10SA = (uint16_t) samples;
+
+    ADC10CTL0 |= ENC;
+
+    slave_init(SLAVE_ADDRESS, handle_master_command);
+
+    __enable_interrupt();
+
+    uint8_t block_counter = 0;
+    // Beats in blocks that aren't sent are carried over to the next frame
+    bool beat_pending = false;
+
+    uint32_t duty_window_start = duty_time();
+    uint32_t duty_asleep = 0;
+
+    while (1) {
+        uint32_t sleep_start = duty_time();
+
+        // LPM0 keeps SMCLK running for the sample timer, the ADC and the I2C slave
+        __disable_interrupt();
+        if (filled_block == NULL) {
+            // Enable interrupts and sleep at once, so that no block gets lost
+            __bis_SR_register(LPM0_bits | GIE);
+            __disable_interrupt();
+        }
+        __enable_interrupt();
+
+        // A block arrives every 8 ms
+        uint32_t now = duty_time();
+        duty_asleep += now - sleep_start;
+
+        if (now - duty_window_start >= DUTY_WINDOW_LENGTH) {
+            report_duty(now - duty_window_start, duty_asleep);
+
+            duty_window_start = now;
+            duty_asleep = 0;
+        }
+
+        // The I2C slave woke us up
+        if (filled_block == NULL) {
+            continue;
+        }
+
+        // The DTC is writing to the other block in the meantime
+        const uint16_t *block = (const uint16_t *) filled_block;
+        filled_block = NULL;
+
+        uint8_t levels[GOERTZEL_BAND_COUNT];
+        goertzel_analyze(block, levels);
+
+        beat_pending |= detect_beat(levels[0]);
+
+        for (uint8_t band = 0; band < GOERTZEL_BAND_COUNT; band++) {
+            levels[band] = normalize_level(band, levels[band]);
+        }
+
+        peak_decay_counter++;
+        if (peak_decay_counter == PEAK_DECAY_BLOCKS) {
+            peak_decay_counter = 0;
+
+            for (uint8_t band = 0; band < GOERTZEL_BAND_COUNT; band++) {
+                if (band_peaks[band] > 0) {
+                    band_peaks[band]--;
+                }
+            }
+        }
+
+        block_counter++;
+        bool bands_block = block_counter == FRAME_BLOCK_DIVIDER / 2;
+
+        if (block_counter == FRAME_BLOCK_DIVIDER) {
+            block_counter = 0;
+        } else if (!bands_block) {
+            continue;
+        }
+
+        if (!visualizer_enabled) {
+            beat_pending = false;
+            continue;
+        }
+
+        // Drop the frame if the master hasn't fetched the previous one yet
+        if (slave_queue_count() != 0) {
+            continue;
+        }
+
+        if (bands_block) {
+            uint8_t bands[1 + GOERTZEL_BAND_COUNT] = { EXTENDED_COMMAND_VISUALIZER_BANDS };
+
+            for (uint8_t band = 0; band < GOERTZEL_BAND_COUNT; band++) {
+                bands[1 + band] = levels[band];
+            }
+
+            slave_enqueue_extended(bands, sizeof(bands));
+            continue;
+        }
+
+        // Bass -> red, mids -> green, treble -> blue
+        uint8_t frame[] = {
+            EXTENDED_COMMAND_VISUALIZER_FRAME,
+            beat_pending ? VISUALIZER_FLAG_BEAT : 0,
+            max_u8(levels[0], levels[1]),
+            max_u8(levels[2], levels[3]),
+            max_u8(levels[4], levels[5])
+        };
+
+        slave_enqueue_extended(frame, sizeof(frame));
+
+        beat_pending = false;
+    }
+}
+
+__attribute__((interrupt(ADC10_VECTOR)))
+void ADC10_ISR() {
+    // ADC10B1 is set when the first block has just been filled
+    if (ADC10DTC0 & ADC10B1) {
+        filled_block = &samples[0];
+    } else {
+        filled_block = &samples[GOERTZEL_BLOCK_SIZE];
+    }
+
+    __bic_SR_register_on_exit(LPM0_bits);
+}
+
+__attribute__((interrupt(TIMER1_A1_VECTOR)))
+void TIMER1_A1_ISR() {
+    TA1CTL &= ~TAIFG;
+
+    duty_timer_overflows++;
+}